@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Members of a mapped ar(5) archive, in the GNU/SysV or BSD format.
+ *
+ * Symbol tables and the table of long names are skipped, every other
+ * member is returned with its name and data in the mapping.
+ */
+
+#include <sys/types.h>
+
+#include <ar.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmalloc.h"
+
+#define AR_SYMTAB	"/"		/* GNU symbol table */
+#define AR_SYMTAB64	"/SYM64/"	/* GNU 64bit symbol table */
+#define AR_STRTAB	"//"		/* GNU long names */
+#define AR_BSDSYMTAB	"__.SYMDEF"	/* BSD symbol table */
+#define AR_BSDNAME	"#1/"		/* BSD name following the header */
+
+struct ar_iter {
+	const char	*ai_p;
+	size_t		 ai_filesize;
+	size_t		 ai_off;	/* offset of the next header */
+	const char	*ai_names;	/* GNU long names, if any */
+	size_t		 ai_namesz;
+};
+
+int		 isar(const char *, size_t);
+struct ar_iter	*ar_open(const char *, size_t);
+int		 ar_next(struct ar_iter *, const char **, size_t *,
+		     const char **, size_t *);
+void		 ar_close(struct ar_iter *);
+
+static int	 ar_number(const char *, size_t, size_t *);
+
+int
+isar(const char *p, size_t filesize)
+{
+	if (filesize < SARMAG || memcmp(p, ARMAG, SARMAG) != 0)
+		return 0;
+
+	return 1;
+}
+
+struct ar_iter *
+ar_open(const char *p, size_t filesize)
+{
+	struct ar_iter		*ai;
+
+	ai = xcalloc(1, sizeof(*ai));
+	ai->ai_p = p;
+	ai->ai_filesize = filesize;
+	ai->ai_off = SARMAG;
+
+	return ai;
+}
+
+void
+ar_close(struct ar_iter *ai)
+{
+	free(ai);
+}
+
+/*
+ * Parse the space padded decimal number ``s''.
+ */
+static int
+ar_number(const char *s, size_t len, size_t *val)
+{
+	size_t			 i, v = 0;
+
+	for (i = 0; i < len && s[i] >= '0' && s[i] <= '9'; i++) {
+		if (v > (SIZE_MAX - (s[i] - '0')) / 10)
+			return -1;
+		v = v * 10 + (s[i] - '0');
+	}
+	if (i == 0)
+		return -1;
+	for (; i < len; i++) {
+		if (s[i] != ' ')
+			return -1;
+	}
+
+	*val = v;
+	return 0;
+}
+
+/*
+ * Return the next member of the archive: 1 if one is found, 0 at the end
+ * of the archive and -1 if it is corrupted.
+ */
+int
+ar_next(struct ar_iter *ai, const char **pname, size_t *pnamelen,
+    const char **pdata, size_t *psize)
+{
+	const struct ar_hdr	*ah;
+	const char		*name, *data;
+	size_t			 namelen, size, noff;
+
+	while (ai->ai_off < ai->ai_filesize) {
+		if (ai->ai_filesize - ai->ai_off < sizeof(*ah)) {
+			warnx("truncated archive header");
+			return -1;
+		}
+		ah = (const struct ar_hdr *)(ai->ai_p + ai->ai_off);
+		if (memcmp(ah->ar_fmag, ARFMAG, sizeof(ah->ar_fmag)) != 0) {
+			warnx("bad archive header at 0x%zx", ai->ai_off);
+			return -1;
+		}
+		if (ar_number(ah->ar_size, sizeof(ah->ar_size), &size) ||
+		    size > ai->ai_filesize - ai->ai_off - sizeof(*ah)) {
+			warnx("bad archive member size at 0x%zx", ai->ai_off);
+			return -1;
+		}
+
+		data = ai->ai_p + ai->ai_off + sizeof(*ah);
+		ai->ai_off += sizeof(*ah) + size + (size & 1);
+
+		name = ah->ar_name;
+		namelen = sizeof(ah->ar_name);
+		while (namelen > 0 && name[namelen - 1] == ' ')
+			namelen--;
+
+		if (namelen == strlen(AR_STRTAB) &&
+		    memcmp(name, AR_STRTAB, namelen) == 0) {
+			ai->ai_names = data;
+			ai->ai_namesz = size;
+			continue;
+		}
+		if ((namelen == strlen(AR_SYMTAB) &&
+		    memcmp(name, AR_SYMTAB, namelen) == 0) ||
+		    (namelen == strlen(AR_SYMTAB64) &&
+		    memcmp(name, AR_SYMTAB64, namelen) == 0))
+			continue;
+
+		if (namelen > strlen(AR_BSDNAME) &&
+		    memcmp(name, AR_BSDNAME, strlen(AR_BSDNAME)) == 0) {
+			/* BSD long names are at the start of the data. */
+			if (ar_number(name + strlen(AR_BSDNAME),
+			    namelen - strlen(AR_BSDNAME), &namelen) ||
+			    namelen > size) {
+				warnx("bad archive member name");
+				return -1;
+			}
+			name = data;
+			data += namelen;
+			size -= namelen;
+			namelen = strnlen(name, namelen);
+			if (namelen >= strlen(AR_BSDSYMTAB) &&
+			    memcmp(name, AR_BSDSYMTAB,
+			    strlen(AR_BSDSYMTAB)) == 0)
+				continue;
+		} else if (namelen > 1 && name[0] == '/') {
+			/* GNU long names are offsets in their table. */
+			if (ar_number(name + 1, namelen - 1, &noff) ||
+			    noff >= ai->ai_namesz) {
+				warnx("bad archive member name");
+				return -1;
+			}
+			name = ai->ai_names + noff;
+			namelen = 0;
+			while (noff + namelen < ai->ai_namesz &&
+			    name[namelen] != '\n')
+				namelen++;
+			if (namelen > 0 && name[namelen - 1] == '/')
+				namelen--;
+		} else {
+			if (namelen >= strlen(AR_BSDSYMTAB) &&
+			    memcmp(name, AR_BSDSYMTAB,
+			    strlen(AR_BSDSYMTAB)) == 0)
+				continue;
+			if (namelen > 0 && name[namelen - 1] == '/')
+				namelen--;
+		}
+
+		*pname = name;
+		*pnamelen = namelen;
+		*pdata = data;
+		*psize = size;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Generate a BTF section from the same internal types as the CTF one.
+ *
+ * Types keep the order of the CTF section, without ``void'' which is
+ * implicit in BTF.  They are followed by a prototype and a function
+ * for every function symbol, then by a variable for every data object.
+ */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/tree.h>
+#include <sys/ctf.h>
+
+#include <assert.h>
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "itype.h"
+#include "xmalloc.h"
+#include "htab.h"
+#include "btf.h"
+
+#ifndef nitems
+#define nitems(_a)	(sizeof((_a)) / sizeof((_a)[0]))
+#endif
+
+#define MAXIMUM(a, b)	(((a) > (b)) ? (a) : (b))
+
+#define ARRAY_INDEX_NAME	"__ARRAY_SIZE_TYPE__"
+
+/* Growable buffer for the types and strings. */
+struct bbuf {
+	char		*bb_data;
+	size_t		 bb_len;
+	size_t		 bb_size;
+};
+
+struct btf {
+	struct bbuf	 b_types;
+	struct bbuf	 b_strs;
+	struct htab	*b_htab;	/* strings already in b_strs */
+	uint32_t	*b_ids;		/* BTF ID of every CTF type ID */
+	uint32_t	 b_index;	/* ID of the type of array indexes */
+	uint32_t	 b_last;	/* last assigned ID */
+};
+
+struct bstr {
+	struct htab_entry bs_key;	/* Must be first */
+	uint32_t	 bs_off;
+};
+
+extern struct itype	*void_it;
+
+int		 btf_generate(int, const char *);
+
+static void
+bbuf_add(struct bbuf *bb, const void *data, size_t len)
+{
+	if (bb->bb_len + len > bb->bb_size) {
+		bb->bb_size = MAXIMUM(bb->bb_size * 2, bb->bb_len + len);
+		bb->bb_data = xrealloc(bb->bb_data, bb->bb_size);
+	}
+	memcpy(bb->bb_data + bb->bb_len, data, len);
+	bb->bb_len += len;
+}
+
+static uint32_t
+btf_string(struct btf *b, const char *str)
+{
+	struct bstr	*bs;
+	unsigned int	 slot;
+	size_t		 len;
+
+	if (str == NULL || *str == '\0')
+		return 0;
+
+	len = strlen(str);
+	bs = (struct bstr *)htab_find(b->b_htab, str, len, &slot);
+	if (bs != NULL)
+		return bs->bs_off;
+
+	bs = xmalloc(sizeof(*bs));
+	bs->bs_off = b->b_strs.bb_len;
+	bbuf_add(&b->b_strs, str, len + 1);
+	htab_insert(b->b_htab, slot, &bs->bs_key, str, len);
+
+	return bs->bs_off;
+}
+
+/*
+ * BTF ID of ``it'', 0 for ``void''.
+ */
+static uint32_t
+btf_ref(struct btf *b, struct itype *it)
+{
+	if (it == NULL || it == void_it)
+		return 0;
+
+	assert(b->b_ids[it->it_idx] != 0);
+	return b->b_ids[it->it_idx];
+}
+
+static void
+btf_add_head(struct btf *b, const char *name, int kind, int vlen,
+    uint32_t sizetype)
+{
+	struct btf_type		 bt;
+
+	bt.bt_name = btf_string(b, name);
+	bt.bt_info = BTF_INFO(kind, vlen);
+	bt.bt_size = sizetype;
+	bbuf_add(&b->b_types, &bt, sizeof(bt));
+}
+
+static void
+btf_add_int(struct btf *b, const char *name, uint16_t enc, uint32_t bits)
+{
+	uint32_t		 data, benc = 0;
+
+	/* BTF only knows of one encoding per integer. */
+	if (enc & CTF_INT_BOOL)
+		benc = BTF_INT_BOOL;
+	else if (enc & CTF_INT_SIGNED)
+		benc = BTF_INT_SIGNED;
+	else if (enc & CTF_INT_CHAR)
+		benc = BTF_INT_CHAR;
+
+	btf_add_head(b, name, BTF_KIND_INT, 0, (bits + 7) / 8);
+	data = BTF_INT_DATA(benc, 0, bits);
+	bbuf_add(&b->b_types, &data, sizeof(data));
+}
+
+/*
+ * Append the arguments of the function or function type ``it''.
+ * Arguments of functions must be named, so unnamed ones of a
+ * function symbol are called after their position.
+ */
+static void
+btf_add_params(struct btf *b, struct itype *it)
+{
+	struct imember		*im;
+	struct btf_param	 bp;
+	char			 name[16];
+	const char		*n;
+	int			 i = 0;
+
+	TAILQ_FOREACH(im, &it->it_members, im_next) {
+		n = im_name(im);
+		if ((it->it_flags & ITF_FUNC) && (n == NULL || *n == '\0')) {
+			snprintf(name, sizeof(name), "arg%d", i);
+			n = name;
+		}
+		i++;
+		bp.bp_name = btf_string(b, n);
+		bp.bp_type = btf_ref(b, im->im_refp);
+		bbuf_add(&b->b_types, &bp, sizeof(bp));
+	}
+	if (it->it_flags & ITF_VARARGS) {
+		bp.bp_name = 0;
+		bp.bp_type = 0;
+		bbuf_add(&b->b_types, &bp, sizeof(bp));
+	}
+}
+
+static int
+btf_nparams(struct itype *it)
+{
+	return it->it_nelems + ((it->it_flags & ITF_VARARGS) ? 1 : 0);
+}
+
+static void
+btf_add_type(struct btf *b, struct itype *it)
+{
+	struct imember		*im;
+	struct btf_array	 ba;
+	struct btf_member	 bm;
+	struct btf_enum		 be;
+	struct btf_enum64	 be64;
+	const char		*name = it_name(it);
+	int			 kind, enum64 = 0;
+
+	switch (it->it_type) {
+	case CTF_K_INTEGER:
+		btf_add_int(b, name, it->it_enc, it->it_size);
+		break;
+	case CTF_K_FLOAT:
+		btf_add_head(b, name, BTF_KIND_FLOAT, 0, it->it_size / 8);
+		break;
+	case CTF_K_POINTER:
+	case CTF_K_TYPEDEF:
+	case CTF_K_VOLATILE:
+	case CTF_K_CONST:
+	case CTF_K_RESTRICT:
+		switch (it->it_type) {
+		case CTF_K_POINTER:
+			kind = BTF_KIND_PTR;
+			name = NULL;
+			break;
+		case CTF_K_TYPEDEF:
+			kind = BTF_KIND_TYPEDEF;
+			break;
+		case CTF_K_VOLATILE:
+			kind = BTF_KIND_VOLATILE;
+			name = NULL;
+			break;
+		case CTF_K_CONST:
+			kind = BTF_KIND_CONST;
+			name = NULL;
+			break;
+		default:
+			kind = BTF_KIND_RESTRICT;
+			name = NULL;
+			break;
+		}
+		btf_add_head(b, name, kind, 0, btf_ref(b, it->it_refp));
+		break;
+	case CTF_K_ARRAY:
+		btf_add_head(b, NULL, BTF_KIND_ARRAY, 0, 0);
+		ba.ba_type = btf_ref(b, it->it_refp);
+		ba.ba_index = b->b_index;
+		ba.ba_nelems = it->it_nelems;
+		bbuf_add(&b->b_types, &ba, sizeof(ba));
+		break;
+	case CTF_K_STRUCT:
+	case CTF_K_UNION:
+		kind = (it->it_type == CTF_K_STRUCT) ?
+		    BTF_KIND_STRUCT : BTF_KIND_UNION;
+		btf_add_head(b, name, kind, it->it_nelems, it->it_size);
+		TAILQ_FOREACH(im, &it->it_members, im_next) {
+			bm.bm_name = btf_string(b, im_name(im));
+			bm.bm_type = btf_ref(b, im->im_refp);
+			bm.bm_offset = im->im_off;
+			bbuf_add(&b->b_types, &bm, sizeof(bm));
+		}
+		break;
+	case CTF_K_ENUM:
+		TAILQ_FOREACH(im, &it->it_members, im_next) {
+			if ((int64_t)im->im_ref != (int32_t)im->im_ref)
+				enum64 = 1;
+		}
+		kind = enum64 ? BTF_KIND_ENUM64 : BTF_KIND_ENUM;
+		btf_add_head(b, name, kind, it->it_nelems, it->it_size);
+		TAILQ_FOREACH(im, &it->it_members, im_next) {
+			if (enum64) {
+				be64.be_name = btf_string(b, im_name(im));
+				be64.be_lo = (uint32_t)im->im_ref;
+				be64.be_hi = (uint32_t)((uint64_t)im->im_ref >> 32);
+				bbuf_add(&b->b_types, &be64, sizeof(be64));
+			} else {
+				be.be_name = btf_string(b, im_name(im));
+				be.be_value = (int32_t)im->im_ref;
+				bbuf_add(&b->b_types, &be, sizeof(be));
+			}
+		}
+		break;
+	case CTF_K_FUNCTION:
+		btf_add_head(b, NULL, BTF_KIND_FUNC_PROTO, btf_nparams(it),
+		    btf_ref(b, it->it_refp));
+		btf_add_params(b, it);
+		break;
+	default:
+		assert(0);
+		break;
+	}
+}
+
+/*
+ * Number the types, array indexes, functions and variables in the
+ * order they are written.
+ */
+static void
+btf_number(struct btf *b)
+{
+	struct itype		*it;
+	int			 arrays = 0;
+
+	b->b_ids = xcalloc(tidx + 1, sizeof(*b->b_ids));
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ) || it == void_it)
+			continue;
+		b->b_ids[it->it_idx] = ++b->b_last;
+		if (it->it_type == CTF_K_ARRAY)
+			arrays = 1;
+	}
+
+	/* Like CTF, arrays are indexed by "long" if there is one. */
+	if (long_tidx != 0 && b->b_ids[long_tidx] != 0)
+		b->b_index = b->b_ids[long_tidx];
+	else if (arrays)
+		b->b_index = ++b->b_last;
+}
+
+/*
+ * Generate a BTF section from the internal type representation and
+ * write it to ``fd''.  The section is not compressed.
+ */
+int
+btf_generate(int fd, const char *path)
+{
+	struct btf		 b;
+	struct btf_header	 bh;
+	struct btf_var		 bv;
+	struct itype		*it;
+	struct bstr		*bs;
+	unsigned int		 pos;
+	uint32_t		 proto;
+	ssize_t			 n;
+	size_t			 off, i;
+	int			 error = 0;
+	struct {
+		const void	*data;
+		size_t		 len;
+	} iov[3];
+
+	memset(&b, 0, sizeof(b));
+	b.b_htab = htab_init(10);
+	bbuf_add(&b.b_strs, "", 1);
+
+	btf_number(&b);
+
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ) || it == void_it)
+			continue;
+
+		btf_add_type(&b, it);
+	}
+	if (b.b_index != 0 && (long_tidx == 0 || b.b_ids[long_tidx] == 0))
+		btf_add_int(&b, ARRAY_INDEX_NAME, 0, 32);
+
+	TAILQ_FOREACH(it, &ifuncq, it_symb) {
+		if (it->it_type == CTF_K_UNKNOWN)
+			continue;
+
+		proto = ++b.b_last;
+		btf_add_head(&b, NULL, BTF_KIND_FUNC_PROTO, btf_nparams(it),
+		    btf_ref(&b, it->it_refp));
+		btf_add_params(&b, it);
+
+		++b.b_last;
+		btf_add_head(&b, it_name(it), BTF_KIND_FUNC,
+		    (it->it_flags & ITF_GLOBAL) ?
+		    BTF_LINKAGE_GLOBAL : BTF_LINKAGE_STATIC, proto);
+	}
+
+	TAILQ_FOREACH(it, &iobjq, it_symb) {
+		/* Symbols without debug information refer to themselves. */
+		if (it->it_refp == NULL || it->it_refp == it)
+			continue;
+
+		++b.b_last;
+		btf_add_head(&b, it_name(it), BTF_KIND_VAR, 0,
+		    btf_ref(&b, it->it_refp));
+		bv.bv_linkage = (it->it_flags & ITF_GLOBAL) ?
+		    BTF_LINKAGE_GLOBAL : BTF_LINKAGE_STATIC;
+		bbuf_add(&b.b_types, &bv, sizeof(bv));
+	}
+
+	memset(&bh, 0, sizeof(bh));
+	bh.bh_magic = BTF_MAGIC;
+	bh.bh_version = BTF_VERSION;
+	bh.bh_hdrlen = sizeof(bh);
+	bh.bh_typeoff = 0;
+	bh.bh_typelen = b.b_types.bb_len;
+	bh.bh_stroff = b.b_types.bb_len;
+	bh.bh_strlen = b.b_strs.bb_len;
+
+	iov[0].data = &bh;
+	iov[0].len = sizeof(bh);
+	iov[1].data = b.b_types.bb_data;
+	iov[1].len = b.b_types.bb_len;
+	iov[2].data = b.b_strs.bb_data;
+	iov[2].len = b.b_strs.bb_len;
+	for (i = 0; i < nitems(iov) && error == 0; i++) {
+		for (off = 0; off < iov[i].len; off += n) {
+			n = write(fd, (const char *)iov[i].data + off,
+			    iov[i].len - off);
+			if (n == -1) {
+				warn("unable to write %zu bytes for %s",
+				    iov[i].len - off, path);
+				error = -1;
+				break;
+			}
+		}
+	}
+
+	for (bs = htab_first(b.b_htab, &pos); bs != NULL;
+	    bs = htab_next(b.b_htab, &pos))
+		free(bs);
+	htab_free(b.b_htab);
+	free(b.b_types.bb_data);
+	free(b.b_strs.bb_data);
+	free(b.b_ids);
+
+	return error;
+}
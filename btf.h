@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _BTF_H_
+#define _BTF_H_
+
+/*
+ * BPF Type Format, as loaded by Linux from a .BTF section.
+ *
+ * The header is followed by the type section then the string table,
+ * at the given offsets from the end of the header.  Type IDs start at
+ * 1 in the order types are written, 0 is ``void''.
+ */
+
+#define BTF_MAGIC		0xeb9f
+#define BTF_VERSION		1
+
+struct btf_header {
+	uint16_t	bh_magic;
+	uint8_t		bh_version;
+	uint8_t		bh_flags;
+	uint32_t	bh_hdrlen;	/* size of this header */
+	uint32_t	bh_typeoff;
+	uint32_t	bh_typelen;
+	uint32_t	bh_stroff;
+	uint32_t	bh_strlen;
+};
+
+#define BTF_KIND_INT		1
+#define BTF_KIND_PTR		2
+#define BTF_KIND_ARRAY		3
+#define BTF_KIND_STRUCT		4
+#define BTF_KIND_UNION		5
+#define BTF_KIND_ENUM		6
+#define BTF_KIND_FWD		7
+#define BTF_KIND_TYPEDEF	8
+#define BTF_KIND_VOLATILE	9
+#define BTF_KIND_CONST		10
+#define BTF_KIND_RESTRICT	11
+#define BTF_KIND_FUNC		12
+#define BTF_KIND_FUNC_PROTO	13
+#define BTF_KIND_VAR		14
+#define BTF_KIND_DATASEC	15
+#define BTF_KIND_FLOAT		16
+#define BTF_KIND_ENUM64		19
+
+#define BTF_MAX_VLEN		0xffff
+
+#define BTF_INFO(kind, vlen)	(((kind) << 24) | ((vlen) & BTF_MAX_VLEN))
+
+/*
+ * Common part of all types, followed by kind specific data.  ``bt_size''
+ * is in bytes and is used by integers, floats, structs, unions and
+ * enums, the other kinds refer to another type.
+ */
+struct btf_type {
+	uint32_t	bt_name;	/* offset in the string table */
+	uint32_t	bt_info;	/* kind and vlen */
+	union {
+		uint32_t	_size;
+		uint32_t	_type;
+	} _u;
+#define bt_size	_u._size
+#define bt_type	_u._type
+};
+
+/* Integers are followed by their encoding, offset and # of bits. */
+#define BTF_INT_SIGNED		0x1
+#define BTF_INT_CHAR		0x2
+#define BTF_INT_BOOL		0x4
+
+#define BTF_INT_DATA(enc, off, bits)	\
+	(((enc) << 24) | ((off) << 16) | (bits))
+
+struct btf_array {
+	uint32_t	ba_type;	/* type of the elements */
+	uint32_t	ba_index;	/* type of the index */
+	uint32_t	ba_nelems;
+};
+
+struct btf_member {
+	uint32_t	bm_name;
+	uint32_t	bm_type;
+	uint32_t	bm_offset;	/* in bits */
+};
+
+struct btf_enum {
+	uint32_t	be_name;
+	int32_t		be_value;
+};
+
+struct btf_enum64 {
+	uint32_t	be_name;
+	uint32_t	be_lo;
+	uint32_t	be_hi;
+};
+
+/* Arguments of prototypes, varargs are a last unnamed void argument. */
+struct btf_param {
+	uint32_t	bp_name;
+	uint32_t	bp_type;
+};
+
+/* Linkage of functions, in the vlen of their type, and variables. */
+#define BTF_LINKAGE_STATIC	0
+#define BTF_LINKAGE_GLOBAL	1
+
+struct btf_var {
+	uint32_t	bv_linkage;
+};
+
+#endif /* _BTF_H_ */
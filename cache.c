@@ -0,0 +1,457 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Cache of generated sections, indexed by a hash of everything they
+ * are generated from, so that identical inputs are not parsed again.
+ *
+ * Entries are written to a temporary file in the cache directory and
+ * renamed once complete, so that concurrent runs can share a cache.
+ */
+
+#ifdef __FreeBSD__
+#include <sys/capsicum.h>
+#endif
+#include <sys/types.h>
+#include <sys/elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <sha2.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xmalloc.h"
+
+#define DEBUG_ABBREV	".debug_abbrev"
+#define DEBUG_INFO	".debug_info"
+#define DEBUG_STR	".debug_str"
+#define ELF_STRTAB	".strtab"
+#define SUNW_CTF	".SUNW_ctf"
+
+#define CACHE_VERSION	"ctfconv cache 2"
+#define CACHE_BUFSZ	(64 * 1024)
+
+struct cache {
+	int		 c_dfd;		/* cache directory */
+	const char	*c_dir;
+	SHA2_CTX	 c_ctx;		/* hash of the inputs */
+	char		 c_name[SHA512_256_DIGEST_STRING_LENGTH]; /* entry */
+	char		 c_tmp[SHA512_256_DIGEST_STRING_LENGTH + 32];
+	int		 c_fd;		/* fd of ``c_tmp'' */
+};
+
+struct cache	*cache_open(const char *, const char *, size_t, const char *,
+		     int, const char *, int, const char *, const char *);
+int		 cache_get(struct cache *, int, const char *);
+int		 cache_begin(struct cache *);
+int		 cache_end(struct cache *, int, int, const char *);
+
+static void	 cache_hash(struct cache *, const void *, size_t);
+static int	 cache_hash_elf(struct cache *, int, const char *, int);
+static int	 cache_hash_input(struct cache *, const char *, size_t,
+		     const char *);
+static int	 cache_hash_obj(struct cache *, const char *, size_t,
+		     const char *, int);
+static int	 cache_copy(int, const char *, int, const char *);
+
+/* ar.c */
+int		 isar(const char *, size_t);
+struct ar_iter	*ar_open(const char *, size_t);
+int		 ar_next(struct ar_iter *, const char **, size_t *,
+		     const char **, size_t *);
+void		 ar_close(struct ar_iter *);
+
+/* elf.c */
+int		 iself(const char *, size_t);
+struct elf_index *elf_index_init(const char *, size_t);
+void		 elf_index_free(struct elf_index *);
+ssize_t		 elf_getsymtab(struct elf_index *, const Elf_Sym **, size_t *);
+ssize_t		 elf_getrawsection(struct elf_index *, const char *,
+		     const char **, size_t *);
+ssize_t		 elf_getrelsection(struct elf_index *, ssize_t, ssize_t,
+		     const char **, size_t *, uint32_t *);
+ssize_t		 elf_getsection(struct elf_index *, const char *, const char **,
+		     size_t *);
+
+extern int	 njobs, zlevel, order, btf;
+
+/*
+ * Mix ``data'' in the key of ``c''.  Each part is preceded by its
+ * length so that consecutive parts cannot be confused.
+ */
+static void
+cache_hash(struct cache *c, const void *data, size_t len)
+{
+	uint64_t		 l = len;
+
+	SHA512_256Update(&c->c_ctx, (const uint8_t *)&l, sizeof(l));
+	if (len > 0)
+		SHA512_256Update(&c->c_ctx, data, len);
+}
+
+/*
+ * Mix in the key of ``c'' the parts of the ELF file ``fd'' sections
+ * are generated from.  If ``ctf'' is set, it is a parent and only its
+ * CTF data matters, if it is not an ELF file it is a raw section.
+ */
+static int
+cache_hash_elf(struct cache *c, int fd, const char *path, int ctf)
+{
+	struct stat		 st;
+	char			*p;
+	int			 error;
+
+	if (fstat(fd, &st) == -1) {
+		warn("fstat %s", path);
+		return 1;
+	}
+	if ((uintmax_t)st.st_size > SIZE_MAX) {
+		warnx("file too big to fit memory");
+		return 1;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		err(1, "mmap");
+
+	if (ctf)
+		error = cache_hash_obj(c, p, st.st_size, path, ctf);
+	else
+		error = cache_hash_input(c, p, st.st_size, path);
+	munmap(p, st.st_size);
+
+	return error;
+}
+
+/*
+ * Mix in the key of ``c'' the ELF file or archive ``p'', already in
+ * memory.  The ELF members of an archive are mixed in order.
+ */
+static int
+cache_hash_input(struct cache *c, const char *p, size_t filesize,
+    const char *path)
+{
+	struct ar_iter		*ai;
+	const char		*name, *data;
+	size_t			 namelen, size;
+	char			*copy;
+	int			 r;
+
+	if (!isar(p, filesize))
+		return cache_hash_obj(c, p, filesize, path, 0);
+
+	ai = ar_open(p, filesize);
+	while ((r = ar_next(ai, &name, &namelen, &data, &size)) == 1) {
+		if (size < SELFMAG || memcmp(data, ELFMAG, SELFMAG) != 0)
+			continue;
+
+		/* Members are only aligned on 2 bytes. */
+		copy = NULL;
+		if ((uintptr_t)data % sizeof(uint64_t) != 0) {
+			copy = xmalloc(size);
+			memcpy(copy, data, size);
+			data = copy;
+		}
+		if (iself(data, size))
+			cache_hash_obj(c, data, size, path, 0);
+		free(copy);
+	}
+	ar_close(ai);
+
+	return (r == -1);
+}
+
+/*
+ * Mix in the key of ``c'' the ELF file or raw section ``p''.
+ */
+static int
+cache_hash_obj(struct cache *c, const char *p, size_t filesize,
+    const char *path, int ctf)
+{
+	struct elf_index	*ei = NULL;
+	const char		*data, *strtab = NULL;
+	const Elf_Sym		*symtab = NULL, *sym;
+	const char		*sname[] = { DEBUG_ABBREV, DEBUG_INFO,
+				     DEBUG_STR };
+	size_t			 datasz, strtabsz = 0, nsymb = 0;
+	size_t			 i, len, symsz = 0, symlen = 0, infosz;
+	ssize_t			 sidx, rel;
+	char			*syms = NULL;
+	uint8_t			 info[2 + sizeof(uint64_t)];
+	uint64_t		 value;
+	uint32_t		 type;
+	uint16_t		 machine;
+	int			 error = 1, reloc = 0;
+
+	if (!iself(p, filesize)) {
+		if (ctf) {
+			cache_hash(c, p, filesize);
+			error = 0;
+		}
+		goto out;
+	}
+	if ((ei = elf_index_init(p, filesize)) == NULL)
+		goto out;
+
+	if (ctf) {
+		if (elf_getsection(ei, SUNW_CTF, &data, &datasz) == -1) {
+			warnx("%s: %s section not found", path, SUNW_CTF);
+			goto out;
+		}
+		cache_hash(c, data, datasz);
+		error = 0;
+		goto out;
+	}
+
+	/*
+	 * Sections are hashed as stored, followed by the relocations
+	 * applied to them before parsing, so that a hit does not need
+	 * to relocate them.  The machine tells how to apply them.
+	 */
+	machine = ((const Elf_Ehdr *)p)->e_machine;
+	cache_hash(c, &machine, sizeof(machine));
+	for (i = 0; i < sizeof(sname) / sizeof(sname[0]); i++) {
+		data = NULL;
+		datasz = 0;
+		sidx = elf_getrawsection(ei, sname[i], &data, &datasz);
+		cache_hash(c, data, datasz);
+
+		rel = -1;
+		while (sidx != -1 && (rel = elf_getrelsection(ei, sidx, rel,
+		    &data, &datasz, &type)) != -1) {
+			cache_hash(c, &type, sizeof(type));
+			cache_hash(c, data, datasz);
+			reloc = 1;
+		}
+		type = SHT_NULL;
+		cache_hash(c, &type, sizeof(type));
+	}
+
+	/*
+	 * Only the order, names and kind of symbols end up in the
+	 * output, not their value, so relinking keeps the same key.
+	 * Values are hashed along with relocations, which add them.
+	 */
+	elf_getsymtab(ei, &symtab, &nsymb);
+	elf_getsection(ei, ELF_STRTAB, &strtab, &strtabsz);
+	infosz = reloc ? sizeof(info) : 2;
+	for (i = 0; i < nsymb; i++) {
+		sym = &symtab[i];
+		info[0] = sym->st_info;
+		info[1] = (sym->st_shndx == SHN_UNDEF ||
+		    sym->st_shndx == SHN_COMMON);
+		value = sym->st_value;
+		memcpy(info + 2, &value, sizeof(value));
+		len = 0;
+		if (strtab != NULL && sym->st_name < strtabsz)
+			len = strnlen(strtab + sym->st_name,
+			    strtabsz - sym->st_name);
+
+		if (symlen + infosz + len + 1 > symsz) {
+			symsz = symsz * 2 + infosz + len + 1;
+			syms = xrealloc(syms, symsz);
+		}
+		memcpy(syms + symlen, info, infosz);
+		symlen += infosz;
+		if (len > 0)
+			memcpy(syms + symlen, strtab + sym->st_name, len);
+		syms[symlen + len] = '\0';
+		symlen += len + 1;
+	}
+	cache_hash(c, syms, symlen);
+	free(syms);
+	error = 0;
+
+out:
+	elf_index_free(ei);
+	return error;
+}
+
+/*
+ * Compute the key of the section generated from ``ip'', its debug file
+ * ``dfd'' and ``pfd'' if not -1 and the current options, and open the
+ * cache directory.
+ */
+struct cache *
+cache_open(const char *dir, const char *ip, size_t isize, const char *ipath,
+    int dfd, const char *dpath, int pfd, const char *ppath, const char *label)
+{
+#ifdef __FreeBSD__
+	cap_rights_t		 rights;
+#endif
+	struct cache		*c;
+	const char		*name;
+	int			 opts[4];
+
+	c = xcalloc(1, sizeof(*c));
+	c->c_dir = dir;
+	c->c_fd = -1;
+	SHA512_256Init(&c->c_ctx);
+
+	cache_hash(c, CACHE_VERSION, sizeof(CACHE_VERSION));
+	opts[0] = btf;
+	opts[1] = zlevel;
+	opts[2] = order;
+	opts[3] = njobs;
+	cache_hash(c, opts, sizeof(opts));
+	cache_hash(c, label, (label != NULL) ? strlen(label) + 1 : 0);
+
+	if (cache_hash_input(c, ip, isize, ipath) != 0)
+		goto bad;
+	if (dfd != -1 && cache_hash_elf(c, dfd, dpath, 0) != 0)
+		goto bad;
+
+	/* The parent is recorded by name in the output. */
+	if (pfd != -1) {
+		name = strrchr(ppath, '/');
+		name = (name != NULL) ? name + 1 : ppath;
+		cache_hash(c, name, strlen(name) + 1);
+		if (cache_hash_elf(c, pfd, ppath, 1) != 0)
+			goto bad;
+	}
+
+	SHA512_256End(&c->c_ctx, c->c_name);
+	snprintf(c->c_tmp, sizeof(c->c_tmp), "%s.%ld.tmp", c->c_name,
+	    (long)getpid());
+
+	c->c_dfd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (c->c_dfd == -1) {
+		warn("open %s", dir);
+		goto bad;
+	}
+
+#ifdef __FreeBSD__
+	cap_rights_init(&rights, CAP_CREATE, CAP_LOOKUP, CAP_READ, CAP_WRITE,
+	    CAP_FSTAT, CAP_SEEK, CAP_FTRUNCATE, CAP_RENAMEAT_SOURCE,
+	    CAP_RENAMEAT_TARGET, CAP_UNLINKAT);
+	if (cap_rights_limit(c->c_dfd, &rights) == -1) {
+		warn("cap_rights_limit");
+		close(c->c_dfd);
+		goto bad;
+	}
+#endif
+
+	return c;
+
+bad:
+	free(c);
+	return NULL;
+}
+
+static int
+cache_copy(int fd, const char *path, int ofd, const char *opath)
+{
+	char			*buf;
+	ssize_t			 n, w;
+	size_t			 off;
+	int			 error = 0;
+
+	buf = xmalloc(CACHE_BUFSZ);
+	while ((n = read(fd, buf, CACHE_BUFSZ)) != 0) {
+		if (n == -1) {
+			warn("read %s", path);
+			error = 1;
+			break;
+		}
+		for (off = 0; off < (size_t)n; off += w) {
+			w = write(ofd, buf + off, n - off);
+			if (w == -1) {
+				warn("unable to write %zu bytes for %s",
+				    n - off, opath);
+				error = 1;
+				break;
+			}
+		}
+		if (error)
+			break;
+	}
+	free(buf);
+
+	return error;
+}
+
+/*
+ * Copy the cached section to ``ofd''.  Returns 0 on a hit, 1 if the
+ * section is not in the cache and -1 if it could not be copied.
+ */
+int
+cache_get(struct cache *c, int ofd, const char *opath)
+{
+	int			 fd, error;
+
+	fd = openat(c->c_dfd, c->c_name, O_RDONLY);
+	if (fd == -1)
+		return 1;
+
+	error = cache_copy(fd, c->c_name, ofd, opath);
+	close(fd);
+
+	return error ? -1 : 0;
+}
+
+/*
+ * Create the temporary file the section is generated in, returns its
+ * fd or -1 if the section cannot be cached.
+ */
+int
+cache_begin(struct cache *c)
+{
+	c->c_fd = openat(c->c_dfd, c->c_tmp, O_RDWR | O_CREAT | O_TRUNC,
+	    0644);
+	if (c->c_fd == -1)
+		warn("open %s/%s", c->c_dir, c->c_tmp);
+
+	return c->c_fd;
+}
+
+/*
+ * Copy the section generated by cache_begin() to ``ofd'' and add it
+ * to the cache unless ``error'' is set, then release ``c''.
+ */
+int
+cache_end(struct cache *c, int error, int ofd, const char *opath)
+{
+	if (error == 0 && lseek(c->c_fd, 0, SEEK_SET) == -1) {
+		warn("lseek %s/%s", c->c_dir, c->c_tmp);
+		error = 1;
+	}
+	if (error == 0)
+		error = cache_copy(c->c_fd, c->c_tmp, ofd, opath);
+
+	/*
+	 * A concurrent run may have added the same entry, it is equal.
+	 * Failing to add it does not affect the output.
+	 */
+	if (error == 0 && renameat(c->c_dfd, c->c_tmp, c->c_dfd,
+	    c->c_name) == 0)
+		c->c_tmp[0] = '\0';
+	else if (error == 0)
+		warn("rename %s/%s", c->c_dir, c->c_tmp);
+	if (c->c_tmp[0] != '\0')
+		unlinkat(c->c_dfd, c->c_tmp, 0);
+
+	close(c->c_fd);
+	close(c->c_dfd);
+	free(c);
+
+	return error;
+}
@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Load the types of an existing CTF section so that they can be used
+ * as the parent of the generated one.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+#include <sys/tree.h>
+#include <sys/ctf.h>
+
+#include <err.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ZLIB
+#include <zlib.h>
+#endif /* ZLIB */
+
+#include "itype.h"
+#include "xmalloc.h"
+
+#define SUNW_CTF	".SUNW_ctf"
+
+/* Type IDs of a parent, child IDs have the high bit set. */
+#define CTF_PARENT_MAX	0x7fff
+
+int		 ctf_parent_load(int, const char *);
+int		 ctf_load(const char *, size_t, const char *);
+void		 ctf_parent_insert(size_t);
+static int	 ctf_load_types(const char *, size_t, const char *, size_t,
+		     const char *);
+
+/* elf.c */
+int		 iself(const char *, size_t);
+struct elf_index *elf_index_init(const char *, size_t);
+void		 elf_index_free(struct elf_index *);
+ssize_t		 elf_getsection(struct elf_index *, const char *, const char **,
+		     size_t *);
+
+/* parse.c */
+struct itype	*it_new(uint64_t, size_t, const char *, uint32_t, uint16_t,
+		     uint64_t, uint16_t, unsigned int);
+struct imember	*im_new(const char *, size_t, size_t);
+void		 it_parent_insert(struct itype *);
+
+extern struct itype	*void_it;
+
+/* label and name of the parent, if any */
+char		*parlabel, *parname;
+
+/* types of the parent, by ID, until the size of pointers is known */
+static struct itype	**parent_types;
+static size_t		  parent_ntypes;
+
+/*
+ * Load the CTF section of ``path'', either a raw section as written
+ * by ctfconv(1) or an ELF file with a .SUNW_ctf section.
+ */
+int
+ctf_parent_load(int fd, const char *path)
+{
+	struct stat		 st;
+	struct elf_index	*ei;
+	const char		*data;
+	size_t			 datasz;
+	const char		*name;
+	char			*p;
+	int			 error = 1;
+
+	if (fstat(fd, &st) == -1) {
+		warn("fstat %s", path);
+		return 1;
+	}
+	if ((uintmax_t)st.st_size > SIZE_MAX) {
+		warnx("file too big to fit memory");
+		return 1;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+		err(1, "mmap");
+
+	data = p;
+	datasz = st.st_size;
+	if (iself(p, st.st_size)) {
+		if ((ei = elf_index_init(p, st.st_size)) == NULL)
+			goto out;
+		if (elf_getsection(ei, SUNW_CTF, &data, &datasz) == -1) {
+			warnx("%s: %s section not found", path, SUNW_CTF);
+			elf_index_free(ei);
+			goto out;
+		}
+		elf_index_free(ei);
+	}
+
+	error = ctf_load(data, datasz, path);
+
+	/* The parent is referred to by the last component of its path. */
+	if (error == 0) {
+		name = strrchr(path, '/');
+		parname = xstrdup(name != NULL ? name + 1 : path);
+	}
+
+out:
+	munmap(p, st.st_size);
+	return error;
+}
+
+/*
+ * Insert the types of the CTF section ``p'' in the trees used to merge
+ * the types parsed from DWARF, so that they are referenced instead of
+ * being emitted again.
+ */
+int
+ctf_load(const char *p, size_t len, const char *path)
+{
+	struct ctf_header	 cth;
+	const char		*data;
+	char			*buf = NULL;
+	size_t			 datasz;
+	int			 error;
+
+	if (len < sizeof(cth)) {
+		warnx("%s: truncated CTF header", path);
+		return 1;
+	}
+	memcpy(&cth, p, sizeof(cth));
+
+	if (cth.cth_magic != CTF_MAGIC || cth.cth_version != CTF_VERSION) {
+		warnx("%s: unsupported CTF data", path);
+		return 1;
+	}
+	if (cth.cth_parname != 0) {
+		warnx("%s: CTF data already has a parent", path);
+		return 1;
+	}
+	if (cth.cth_lbloff > cth.cth_objtoff ||
+	    cth.cth_objtoff > cth.cth_typeoff ||
+	    cth.cth_typeoff > cth.cth_stroff ||
+	    cth.cth_stroff + cth.cth_strlen < cth.cth_stroff) {
+		warnx("%s: invalid CTF header", path);
+		return 1;
+	}
+
+	data = p + sizeof(cth);
+	datasz = cth.cth_stroff + cth.cth_strlen;
+	if (cth.cth_flags & CTF_F_COMPRESS) {
+#ifdef ZLIB
+		uLongf		 destlen = datasz;
+
+		buf = xmalloc(datasz);
+		if (uncompress((Bytef *)buf, &destlen, (const Bytef *)data,
+		    len - sizeof(cth)) != Z_OK || destlen != datasz) {
+			warnx("%s: unable to inflate CTF data", path);
+			free(buf);
+			return 1;
+		}
+		data = buf;
+#else
+		warnx("%s: compressed CTF data not supported", path);
+		return 1;
+#endif /* ZLIB */
+	} else if (len - sizeof(cth) < datasz) {
+		warnx("%s: truncated CTF data", path);
+		return 1;
+	}
+
+	error = ctf_load_types(data + cth.cth_typeoff,
+	    cth.cth_stroff - cth.cth_typeoff, data + cth.cth_stroff,
+	    cth.cth_strlen, path);
+
+	/* Use the last label to identify the parent. */
+	if (error == 0 && cth.cth_objtoff - cth.cth_lbloff >=
+	    sizeof(struct ctf_lblent)) {
+		struct ctf_lblent	 lbl;
+
+		memcpy(&lbl, data + cth.cth_objtoff - sizeof(lbl),
+		    sizeof(lbl));
+		if (lbl.ctl_label < cth.cth_strlen)
+			parlabel = xstrdup(data + cth.cth_stroff +
+			    lbl.ctl_label);
+	}
+
+	free(buf);
+	return error;
+}
+
+static const char *
+ctf_name(const char *stab, size_t stabsz, uint32_t off)
+{
+	/* Names in an external string table are not supported. */
+	if (off == 0 || off >= stabsz || (off >> 31) != 0)
+		return NULL;
+
+	return stab + off;
+}
+
+static int
+ctf_load_types(const char *p, size_t len, const char *stab, size_t stabsz,
+    const char *path)
+{
+	struct itype		**byid, *it;
+	struct imember		 *im;
+	struct ctf_type		  ctt;
+	struct ctf_array	  cta;
+	size_t			  off = 0, ntypes, i, ctsz, vsz, size;
+	uint32_t		  data;
+	uint16_t		  id;
+	int			  kind, vlen;
+
+	ntypes = 0;
+	byid = xcalloc(CTF_PARENT_MAX + 1, sizeof(*byid));
+
+	/*
+	 * First pass: create a type for each entry and save the IDs of
+	 * the types it refers to in it_ref and im_ref.
+	 */
+	while (off + sizeof(struct ctf_stype) <= len) {
+		if (ntypes == CTF_PARENT_MAX) {
+			warnx("%s: too many types", path);
+			goto bad;
+		}
+		id = ++ntypes;
+
+		memset(&ctt, 0, sizeof(ctt));
+		memcpy(&ctt, p + off, sizeof(struct ctf_stype));
+		kind = CTF_INFO_KIND(ctt.ctt_info);
+		vlen = CTF_INFO_VLEN(ctt.ctt_info);
+
+		ctsz = sizeof(struct ctf_stype);
+		size = ctt.ctt_size;
+		if (ctt.ctt_size == CTF_LSIZE_SENT) {
+			if (off + sizeof(ctt) > len)
+				goto trunc;
+			memcpy(&ctt, p + off, sizeof(ctt));
+			ctsz = sizeof(ctt);
+			size = ((uint64_t)ctt.ctt_lsizehi << 32) |
+			    ctt.ctt_lsizelo;
+		}
+		off += ctsz;
+
+		switch (kind) {
+		case CTF_K_INTEGER:
+		case CTF_K_FLOAT:
+			vsz = sizeof(data);
+			break;
+		case CTF_K_ARRAY:
+			vsz = sizeof(cta);
+			break;
+		case CTF_K_FUNCTION:
+			vsz = (vlen + (vlen & 1)) * sizeof(uint16_t);
+			break;
+		case CTF_K_STRUCT:
+		case CTF_K_UNION:
+			if (size < CTF_LSTRUCT_THRESH)
+				vsz = vlen * sizeof(struct ctf_member);
+			else
+				vsz = vlen * sizeof(struct ctf_lmember);
+			break;
+		case CTF_K_ENUM:
+			vsz = vlen * sizeof(struct ctf_enum);
+			break;
+		default:
+			vsz = 0;
+			break;
+		}
+		if (off + vsz > len)
+			goto trunc;
+
+		it = it_new(id, 0, ctf_name(stab, stabsz, ctt.ctt_name), 0, 0,
+		    0, kind, ITF_PARENT);
+		byid[id] = it;
+
+		switch (kind) {
+		case CTF_K_INTEGER:
+		case CTF_K_FLOAT:
+			memcpy(&data, p + off, sizeof(data));
+			it->it_size = CTF_INT_BITS(data);
+			it->it_enc = CTF_INT_ENCODING(data);
+			break;
+		case CTF_K_ARRAY:
+			memcpy(&cta, p + off, sizeof(cta));
+			it->it_ref = cta.cta_contents;
+			it->it_nelems = cta.cta_nelems;
+			break;
+		case CTF_K_POINTER:
+		case CTF_K_TYPEDEF:
+		case CTF_K_VOLATILE:
+		case CTF_K_CONST:
+		case CTF_K_RESTRICT:
+			it->it_ref = ctt.ctt_type;
+			break;
+		case CTF_K_FUNCTION:
+			it->it_ref = ctt.ctt_type;
+			for (i = 0; i < (size_t)vlen; i++) {
+				uint16_t	 arg;
+
+				memcpy(&arg, p + off + i * sizeof(arg),
+				    sizeof(arg));
+				/* A last argument of 0 denotes varargs. */
+				if (arg == 0 && i == (size_t)vlen - 1) {
+					it->it_flags |= ITF_VARARGS;
+					break;
+				}
+				im = im_new(NULL, arg, 0);
+				TAILQ_INSERT_TAIL(&it->it_members, im, im_next);
+				it->it_nelems++;
+			}
+			break;
+		case CTF_K_STRUCT:
+		case CTF_K_UNION:
+			it->it_size = size;
+			for (i = 0; i < (size_t)vlen; i++) {
+				struct ctf_member	 ctm;
+				struct ctf_lmember	 ctlm;
+
+				if (size < CTF_LSTRUCT_THRESH) {
+					memcpy(&ctm, p + off + i * sizeof(ctm),
+					    sizeof(ctm));
+					im = im_new(ctf_name(stab, stabsz,
+					    ctm.ctm_name), ctm.ctm_type,
+					    ctm.ctm_offset);
+				} else {
+					memcpy(&ctlm,
+					    p + off + i * sizeof(ctlm),
+					    sizeof(ctlm));
+					im = im_new(ctf_name(stab, stabsz,
+					    ctlm.ctlm_name), ctlm.ctlm_type,
+					    ((uint64_t)ctlm.ctlm_offsethi << 32)
+					    | ctlm.ctlm_offsetlo);
+				}
+				TAILQ_INSERT_TAIL(&it->it_members, im, im_next);
+			}
+			it->it_nelems = vlen;
+			break;
+		case CTF_K_ENUM:
+			it->it_size = size;
+			for (i = 0; i < (size_t)vlen; i++) {
+				struct ctf_enum		 cte;
+
+				memcpy(&cte, p + off + i * sizeof(cte),
+				    sizeof(cte));
+				im = im_new(ctf_name(stab, stabsz,
+				    cte.cte_name), cte.cte_value, 0);
+				TAILQ_INSERT_TAIL(&it->it_members, im, im_next);
+			}
+			it->it_nelems = vlen;
+			break;
+		default:
+			break;
+		}
+		off += vsz;
+	}
+
+	/*
+	 * Second pass: resolve references.
+	 */
+	for (id = 1; id <= ntypes; id++) {
+		it = byid[id];
+
+		if (it->it_ref != 0) {
+			if (it->it_ref > ntypes || byid[it->it_ref] == NULL) {
+				warnx("%s: type %u refers to unknown type %llu",
+				    path, id, (unsigned long long)it->it_ref);
+				goto bad;
+			}
+			it->it_refp = byid[it->it_ref];
+		}
+
+		if (it->it_type != CTF_K_STRUCT &&
+		    it->it_type != CTF_K_UNION &&
+		    it->it_type != CTF_K_FUNCTION)
+			continue;
+
+		TAILQ_FOREACH(im, &it->it_members, im_next) {
+			if (im->im_ref > ntypes || byid[im->im_ref] == NULL) {
+				warnx("%s: type %u refers to unknown type %zu",
+				    path, id, im->im_ref);
+				goto bad;
+			}
+			im->im_refp = byid[im->im_ref];
+		}
+	}
+
+	/* "void" is the base type without size. */
+	for (id = 1; id <= ntypes; id++) {
+		it = byid[id];
+		if (it->it_type == CTF_K_INTEGER && it->it_size == 0 &&
+		    it_name(it) != NULL && strcmp(it_name(it), "void") == 0) {
+			void_it = it;
+			break;
+		}
+	}
+
+	/* Types are inserted by ctf_parent_insert() once complete. */
+	parent_types = byid;
+	parent_ntypes = ntypes;
+
+	/* Types of the child are numbered after the parent's. */
+	tbase = tidx = CTF_PARENT_MAX + 1;
+
+	return 0;
+
+trunc:
+	warnx("%s: truncated CTF type section", path);
+bad:
+	free(byid);
+	return 1;
+}
+
+/*
+ * Make the types of the parent available to the merge of parsed types.
+ * CTF pointers have no size, the ones of the parent get the size of
+ * the addresses of the input to compare equal to its DWARF pointers.
+ */
+void
+ctf_parent_insert(size_t psz)
+{
+	struct itype		*it;
+	size_t			 id;
+
+	if (parent_types == NULL)
+		return;
+
+	for (id = 1; id <= parent_ntypes; id++) {
+		it = parent_types[id];
+		if (it->it_type == CTF_K_POINTER)
+			it->it_size = psz;
+		it_parent_insert(it);
+	}
+
+	free(parent_types);
+	parent_types = NULL;
+	parent_ntypes = 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _CTFBLK_H_
+#define _CTFBLK_H_
+
+/*
+ * CTF section compressed in independent blocks, written by ctfconv(1)
+ * -b, so that readers only inflate the blocks they need.
+ *
+ * The header is followed by the CTF header, whose offsets are those
+ * of the uncompressed data, then by ``ctb_nblocks'' entries describing
+ * the blocks, then by the blocks.  Each block is a zlib stream.
+ *
+ * The first block holds the labels, data objects and functions, the
+ * last one the string table.  Types are in between, split on type
+ * boundaries into blocks of about ``ctb_blksize'' bytes.  Entries of
+ * type blocks give the ID of their first type and their # of types,
+ * so that the block of a type can be found with a binary search.
+ */
+
+#define CTF_BLK_MAGIC	0xcfb1
+#define CTF_BLK_VERSION	1
+#define CTF_BLK_SIZE	(64 * 1024)
+
+struct ctf_blkhdr {
+	uint16_t	ctb_magic;
+	uint8_t		ctb_version;
+	uint8_t		ctb_pad;
+	uint32_t	ctb_blksize;	/* target size of type blocks */
+	uint32_t	ctb_nblocks;	/* # of blocks */
+	uint32_t	ctb_reserved;
+};
+
+struct ctf_blkent {
+	uint32_t	ctbe_off;	/* offset in the uncompressed data */
+	uint32_t	ctbe_len;	/* size of the uncompressed data */
+	uint32_t	ctbe_zoff;	/* offset of the block in the file */
+	uint32_t	ctbe_zlen;	/* size of the block */
+	uint32_t	ctbe_type;	/* ID of the first type, or 0 */
+	uint32_t	ctbe_ntypes;	/* # of types in the block */
+};
+
+#endif /* _CTFBLK_H_ */
@@ -29,32 +29,67 @@
 
 #include <assert.h>
 #include <err.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <locale.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#ifdef ZLIB
+#include <zlib.h>
+#endif /* ZLIB */
+
 #include "itype.h"
 #include "xmalloc.h"
+#include "ctfidx.h"
 
 #ifndef nitems
 #define nitems(_a)	(sizeof((_a)) / sizeof((_a)[0]))
 #endif
 
+#define MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
+
 #define DEBUG_ABBREV	".debug_abbrev"
 #define DEBUG_INFO	".debug_info"
 #define DEBUG_LINE	".debug_line"
 #define DEBUG_STR	".debug_str"
 #define ELF_STRTAB	".strtab"
+#define SUNW_CTF	".SUNW_ctf"
+#define BTF_SECTION	".BTF"
+
+#define DEBUG_DIR	"/usr/lib/debug"	/* default for separate files */
+#define INPUT_BUFSZ	(1024 * 1024)	/* first read of a piped input */
+
+/* BTF written by its own thread while the other outputs are generated. */
+struct btfjob {
+	pthread_t	 bj_thread;
+	int		 bj_fd;
+	const char	*bj_path;
+	int		 bj_error;
+	int		 bj_threaded;
+};
 
 __dead2 void	 usage(void);
-int		 convert(int, const char *);
-int		 generate(int fd, const char *, const char *, int);
-int		 elf_convert(char *, size_t);
+void		*btf_job(void *);
+char		*input_load(int, const char *, size_t *, int *);
+void		 input_unload(char *, size_t, int);
+int		 convert(const char *, size_t, const char *, int, const char *);
+int		 debug_open(int, const char *, size_t, const char *, char *,
+		     size_t);
+int		 debug_try(const char *, const struct stat *, int, uint32_t);
+int		 embed(const char *, size_t, const char *, int, const char *,
+		     int, const char *, int, const char *, int, const char *,
+		     const char *);
+int		 generate(int fd, const char *, int, const char *, int,
+		     const char *, int, const char *, const char *, int);
+int		 elf_convert(const char *, size_t, const char *, size_t);
+int		 ar_convert(const char *, size_t, const char *);
 void		 elf_sort(void);
 struct itype	*find_symb(struct itype *, size_t);
 void		 dump_type(struct itype *);
@@ -63,14 +98,42 @@ void		 dump_obj(struct itype *, int *);
 
 /* elf.c */
 int		 iself(const char *, size_t);
-int		 elf_getshstab(const char *, size_t, const char **, size_t *);
-ssize_t		 elf_getsymtab(const char *, size_t, const char *, size_t,
-		     const Elf_Sym **, size_t *);
-ssize_t		 elf_getsection(char *, size_t, const char *, const char *,
-		     size_t, const char **, size_t *);
+struct elf_index *elf_index_init(const char *, size_t);
+void		 elf_index_free(struct elf_index *);
+ssize_t		 elf_getsymtab(struct elf_index *, const Elf_Sym **, size_t *);
+ssize_t		 elf_hassection(struct elf_index *, const char *);
+ssize_t		 elf_getsection(struct elf_index *, const char *, const char **,
+		     size_t *);
+ssize_t		 elf_getbuildid(struct elf_index *, const uint8_t **, size_t *);
+ssize_t		 elf_getdebuglink(struct elf_index *, const char **,
+		     uint32_t *);
+struct elf_copy	*elf_copy_begin(const char *, size_t, const char *, int, int,
+		     const char *);
+int		 elf_copy_end(struct elf_copy *, int);
+
+/* ar.c */
+int		 isar(const char *, size_t);
+struct ar_iter	*ar_open(const char *, size_t);
+int		 ar_next(struct ar_iter *, const char **, size_t *,
+		     const char **, size_t *);
+void		 ar_close(struct ar_iter *);
+
+/* ctf.c */
+int		 ctf_parent_load(int, const char *);
+
+/* btf.c */
+int		 btf_generate(int, const char *);
+
+/* cache.c */
+struct cache	*cache_open(const char *, const char *, size_t, const char *,
+		     int, const char *, int, const char *, const char *);
+int		 cache_get(struct cache *, int, const char *);
+int		 cache_begin(struct cache *);
+int		 cache_end(struct cache *, int, int, const char *);
 
 /* parse.c */
 void		 dwarf_parse(const char *, size_t, const char *, size_t);
+void		 types_reorder(int);
 
 const char	*ctf_enc2name(unsigned short);
 
@@ -79,11 +142,20 @@ struct itype_queue itypeq = TAILQ_HEAD_INITIALIZER(itypeq);
 struct itype_queue ifuncq = TAILQ_HEAD_INITIALIZER(ifuncq);
 struct itype_queue iobjq = TAILQ_HEAD_INITIALIZER(iobjq);
 
+int			 njobs = 1;	/* # of threads used for relocs & output */
+int			 zlevel = 9;	/* deflate level, -1 for auto */
+int			 order = TYPE_ORDER_NONE; /* order of emitted types */
+int			 strip;		/* leave debug sections out of copies */
+int			 btf;		/* write BTF instead of CTF */
+const char		*debugdir = DEBUG_DIR;	/* separate debug files */
+
 __dead2 void
 usage(void)
 {
-	fprintf(stderr, "usage: %s [-d] -l label -o outfile file\n",
-	    getprogname());
+	fprintf(stderr, "usage: %s [-deS] [-B btffile] [-b blockfile] "
+	    "[-c cachedir] [-D debugdir] [-f format] [-i indexfile] [-j jobs] "
+	    "[-m mapfile] [-p parent] [-r order] [-z level] [-l label] "
+	    "[-o outfile] file\n", getprogname());
 	exit(1);
 }
 
@@ -93,34 +165,119 @@ main(int argc, char *argv[])
 #ifdef __FreeBSD__
 	cap_rights_t ifdrights, ofdrights;
 #endif
-	const char *filename, *label = NULL, *outfile = NULL;
-	int dump = 0;
+	const char *filename, *label = NULL, *outfile = NULL, *parent = NULL;
+	const char *idxfile = NULL, *mapfile = NULL, *blkfile = NULL;
+	const char *btffile = NULL, *cachedir = NULL;
+	const char *errstr;
+	char dbgpath[PATH_MAX];
+	struct stat st;
+	int dump = 0, elf = 0;
 	int ch, error = 0;
-	int ifd, ofd;
+	int ifd, ofd = -1, pfd = -1, xfd = -1, mfd = -1, bfd = -1, tfd = -1;
+	int cfd = -1, dfd = -1, imapped;
+	char *ip;
+	size_t isize;
+	struct cache *cache = NULL;
+	struct btfjob bj;
 	struct itype *it;
 
 	setlocale(LC_ALL, "");
 
 #ifdef __OpenBSD__
-	if (pledge("stdio rpath wpath cpath", NULL) == -1)
+	if (pledge("stdio rpath wpath cpath fattr", NULL) == -1)
 		err(1, "pledge");
 #endif
 
-	while ((ch = getopt(argc, argv, "dl:o:")) != -1) {
+	while ((ch = getopt(argc, argv, "B:b:c:D:def:i:j:l:m:o:p:r:Sz:")) !=
+	    -1) {
 		switch (ch) {
+		case 'B':
+			if (btffile != NULL)
+				usage();
+			btffile = optarg;
+			break;
+		case 'b':
+#ifndef ZLIB
+			errx(1, "compression is not supported");
+#endif /* ZLIB */
+			if (blkfile != NULL)
+				usage();
+			blkfile = optarg;
+			break;
+		case 'c':
+			if (cachedir != NULL)
+				usage();
+			cachedir = optarg;
+			break;
+		case 'D':
+			debugdir = optarg;
+			break;
 		case 'd':
 			dump = 1;	/* ctfdump(1)-like SUNW_ctf sections */
 			break;
+		case 'e':
+			elf = 1;	/* copy of the input with SUNW_ctf */
+			break;
+		case 'f':
+			if (strcmp(optarg, "ctf") == 0)
+				btf = 0;
+			else if (strcmp(optarg, "btf") == 0)
+				btf = 1;
+			else
+				errx(1, "unknown format: %s", optarg);
+			break;
+		case 'i':
+			if (idxfile != NULL)
+				usage();
+			idxfile = optarg;
+			break;
+		case 'j':
+			njobs = strtonum(optarg, 1, 256, &errstr);
+			if (errstr != NULL)
+				errx(1, "number of jobs is %s: %s", errstr,
+				    optarg);
+			break;
 		case 'l':
 			if (label != NULL)
 				usage();
 			label = optarg;
 			break;
+		case 'm':
+			if (mapfile != NULL)
+				usage();
+			mapfile = optarg;
+			break;
 		case 'o':
 			if (outfile != NULL)
 				usage();
 			outfile = optarg;
 			break;
+		case 'p':
+			if (parent != NULL)
+				usage();
+			parent = optarg;
+			break;
+		case 'r':
+			if (strcmp(optarg, "dfs") == 0)
+				order = TYPE_ORDER_DFS;
+			else if (strcmp(optarg, "bfs") == 0)
+				order = TYPE_ORDER_BFS;
+			else
+				errx(1, "unknown type order: %s", optarg);
+			break;
+		case 'S':
+			strip = 1;
+			break;
+		case 'z':
+			if (strcmp(optarg, "auto") == 0) {
+				zlevel = -1;
+				break;
+			}
+			zlevel = strtonum(optarg, 0, 9, &errstr);
+			if (errstr != NULL)
+				errx(1, "compression level is %s: %s", errstr,
+				    optarg);
+			break;
 		default:
 			usage();
 		}
@@ -132,19 +289,59 @@ main(int argc, char *argv[])
 	if (argc != 1)
 		usage();
 
-	/* Either dump the sections, or write it out. */
-	if ((dump && (outfile != NULL || label != NULL)) ||
-	    (!dump && (outfile == NULL || label == NULL)))
+	/* All the outputs are generated from a single parse. */
+	if (!dump && outfile == NULL && btffile == NULL)
+		usage();
+	if ((outfile != NULL && !btf) != (label != NULL))	/* CTF only */
+		usage();
+	if (outfile == NULL && (elf || idxfile != NULL || mapfile != NULL ||
+	    blkfile != NULL))
+		usage();
+	if (strip && !elf)
+		usage();
+	if (dump && outfile != NULL && strcmp(outfile, "-") == 0)
+		usage();	/* both on stdout */
+
+	/* Sidecars describe CTF data, BTF has no label nor parent. */
+	if (btf && (idxfile != NULL || mapfile != NULL || blkfile != NULL ||
+	    btffile != NULL))
+		usage();
+	if ((btf || btffile != NULL) && parent != NULL)
+		usage();
+
+	/* Only the section written to outfile is cached. */
+	if (cachedir != NULL && (outfile == NULL || dump || elf ||
+	    idxfile != NULL || mapfile != NULL || blkfile != NULL ||
+	    btffile != NULL))
 		usage();
 
 	filename = *argv;
-	ifd = open(filename, O_RDONLY);
-	if (ifd == -1) {
+	if (strcmp(filename, "-") == 0)
+		ifd = STDIN_FILENO;
+	else if ((ifd = open(filename, O_RDONLY)) == -1) {
 		warn("open %s", filename);
 		return 1;
 	}
 
-	if (outfile != NULL) {
+	/* The input is only read once, even from a pipe. */
+	ip = input_load(ifd, filename, &isize, &imapped);
+	if (ip == NULL)
+		return 1;
+
+	/* Debug sections of stripped files are in a separate file. */
+	dfd = debug_open(ifd, ip, isize, filename, dbgpath, sizeof(dbgpath));
+
+	if (parent != NULL) {
+		pfd = open(parent, O_RDONLY);
+		if (pfd == -1) {
+			warn("open %s", parent);
+			return 1;
+		}
+	}
+
+	if (outfile != NULL && strcmp(outfile, "-") == 0)
+		ofd = STDOUT_FILENO;
+	else if (outfile != NULL) {
 		ofd = open(outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 		if (ofd == -1) {
 			warn("open %s", outfile);
@@ -152,6 +349,68 @@ main(int argc, char *argv[])
 		}
 	}
 
+	/* The ELF header of a copy is written last. */
+	if (elf && lseek(ofd, 0, SEEK_CUR) == -1) {
+		warnx("%s: output must be seekable with -e", outfile);
+		return 1;
+	}
+
+	if (idxfile != NULL) {
+		xfd = open(idxfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (xfd == -1) {
+			warn("open %s", idxfile);
+			return -1;
+		}
+	}
+
+	if (mapfile != NULL) {
+		mfd = open(mapfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (mfd == -1) {
+			warn("open %s", mapfile);
+			return -1;
+		}
+	}
+
+	if (blkfile != NULL) {
+		bfd = open(blkfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (bfd == -1) {
+			warn("open %s", blkfile);
+			return -1;
+		}
+	}
+
+	if (btffile != NULL) {
+		tfd = open(btffile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (tfd == -1) {
+			warn("open %s", btffile);
+			return -1;
+		}
+	}
+
+	/* Nothing needs to be parsed if the section is in the cache. */
+	if (cachedir != NULL) {
+		cache = cache_open(cachedir, ip, isize, filename, dfd, dbgpath,
+		    pfd, parent, label);
+		if (cache == NULL)
+			return 1;
+		error = cache_get(cache, ofd, outfile);
+		if (error <= 0)
+			return -error;
+		error = 0;
+	}
+
+	/* A copy of the input keeps its permissions. */
+	if (elf && ofd != STDOUT_FILENO) {
+		if (fstat(ifd, &st) == -1) {
+			warn("fstat %s", filename);
+			return 1;
+		}
+		if (fchmod(ofd, st.st_mode & ACCESSPERMS) == -1) {
+			warn("fchmod %s", outfile);
+			return 1;
+		}
+	}
+
 #ifdef __FreeBSD__
 	if (cap_enter()) {
 		warn("cap_enter");
@@ -160,17 +419,46 @@ main(int argc, char *argv[])
 
 	cap_rights_init(&ifdrights, CAP_FSTAT, CAP_MMAP_R);
 	cap_rights_init(&ofdrights, CAP_WRITE);
+	if (elf)
+		cap_rights_set(&ofdrights, CAP_SEEK, CAP_PWRITE);
 	if (cap_rights_limit(ifd, &ifdrights) == -1 ||
-	    cap_rights_limit(ofd, &ofdrights) == -1) {
+	    (pfd != -1 && cap_rights_limit(pfd, &ifdrights) == -1) ||
+	    (dfd != -1 && cap_rights_limit(dfd, &ifdrights) == -1) ||
+	    (ofd != -1 && cap_rights_limit(ofd, &ofdrights) == -1) ||
+	    (xfd != -1 && cap_rights_limit(xfd, &ofdrights) == -1) ||
+	    (mfd != -1 && cap_rights_limit(mfd, &ofdrights) == -1) ||
+	    (bfd != -1 && cap_rights_limit(bfd, &ofdrights) == -1) ||
+	    (tfd != -1 && cap_rights_limit(tfd, &ofdrights) == -1)) {
 		warn("cap_rights_limit");
 		return -1;
 	}
 #endif
 
-	error = convert(ifd, filename);
+	/* Types of the parent must be known before parsing. */
+	if (pfd != -1) {
+		error = ctf_parent_load(pfd, parent);
+		if (error != 0)
+			return error;
+		close(pfd);
+	}
+
+	error = convert(ip, isize, filename, dfd, dbgpath);
 	if (error != 0)
 		return error;
-	close(ifd);
+	if (dfd != -1)
+		close(dfd);
+
+	types_reorder(order);
+
+	/* The graph is now only read, outputs can be generated at once. */
+	if (btffile != NULL) {
+		bj.bj_fd = tfd;
+		bj.bj_path = btffile;
+		bj.bj_threaded = (pthread_create(&bj.bj_thread, NULL, btf_job,
+		    &bj) == 0);
+		if (!bj.bj_threaded)
+			btf_job(&bj);
+	}
 
 	if (outfile != NULL) {
 #ifdef __OpenBSD__
@@ -178,11 +466,36 @@ main(int argc, char *argv[])
 			err(1, "pledge");
 #endif
 
-		error = generate(ofd, outfile, label, 1);
+		if (cache != NULL)
+			cfd = cache_begin(cache);
+
+		if (elf)
+			error = embed(ip, isize, filename, ofd, outfile, xfd,
+			    idxfile, mfd, mapfile, bfd, blkfile, label);
+		else if (cfd != -1) {
+			if (btf)
+				error = btf_generate(cfd, outfile);
+			else
+				error = generate(cfd, outfile, -1, NULL, -1,
+				    NULL, -1, NULL, label, zlevel);
+			error = cache_end(cache, error, ofd, outfile);
+		} else if (btf)
+			error = btf_generate(ofd, outfile);
+		else
+			error = generate(ofd, outfile, xfd, idxfile, mfd,
+			    mapfile, bfd, blkfile, label, zlevel);
 		if (error != 0)
 			return error;
 		close(ofd);
+		if (xfd != -1)
+			close(xfd);
+		if (mfd != -1)
+			close(mfd);
+		if (bfd != -1)
+			close(bfd);
 	}
+	input_unload(ip, isize, imapped);
+	close(ifd);
 
 	if (dump) {
 #ifdef __OpenBSD__
@@ -206,41 +519,276 @@ main(int argc, char *argv[])
 
 			dump_type(it);
 		}
+	}
 
-		return 0;
+	if (btffile != NULL) {
+		if (bj.bj_threaded)
+			pthread_join(bj.bj_thread, NULL);
+		if (bj.bj_error != 0)
+			return bj.bj_error;
+		close(tfd);
 	}
 
 	return 0;
 }
 
-int
-convert(int fd, const char *path)
+void *
+btf_job(void *arg)
+{
+	struct btfjob *bj = arg;
+
+	bj->bj_error = btf_generate(bj->bj_fd, bj->bj_path);
+	return NULL;
+}
+
+/*
+ * Map the input ``fd'' or, if it cannot be mapped like a pipe, read it
+ * in memory.  ELF files have their section headers at the end, so the
+ * sections needed cannot be picked from a stream before it is read.
+ */
+char *
+input_load(int fd, const char *path, size_t *plen, int *pmapped)
 {
 	struct stat		 st;
-	int			 error = 1;
-	char			*p;
+	char			*p = NULL;
+	size_t			 len = 0, size = 0;
+	ssize_t			 n;
 
 	if (fstat(fd, &st) == -1) {
 		warn("fstat %s", path);
-		close(fd);
-		return 1;
+		return NULL;
 	}
-	if ((uintmax_t)st.st_size > SIZE_MAX) {
-		warnx("file too big to fit memory");
-		close(fd);
-		return 1;
+
+	if (S_ISREG(st.st_mode)) {
+		if ((uintmax_t)st.st_size > SIZE_MAX) {
+			warnx("file too big to fit memory");
+			return NULL;
+		}
+		p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+			err(1, "mmap");
+		*plen = st.st_size;
+		*pmapped = 1;
+		return p;
 	}
 
-	p = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+	for (;;) {
+		if (len == size) {
+			if (size > SIZE_MAX / 2) {
+				warnx("%s: too big to fit memory", path);
+				free(p);
+				return NULL;
+			}
+			size = (size == 0) ? INPUT_BUFSZ : size * 2;
+			p = xrealloc(p, size);
+		}
+		n = read(fd, p + len, size - len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			warn("read %s", path);
+			free(p);
+			return NULL;
+		}
+		if (n == 0)
+			break;
+		len += n;
+	}
+
+	*plen = len;
+	*pmapped = 0;
+	return p;
+}
+
+void
+input_unload(char *p, size_t len, int mapped)
+{
+	if (mapped)
+		munmap(p, len);
+	else
+		free(p);
+}
+
+int
+convert(const char *p, size_t len, const char *path, int dfd,
+    const char *dpath)
+{
+	struct stat		 dst;
+	int			 error = 1;
+	char			*dp = NULL;
+
+	/* Checked by debug_open(). */
+	if (dfd != -1) {
+		if (fstat(dfd, &dst) == -1) {
+			warn("fstat %s", dpath);
+			return 1;
+		}
+		dp = mmap(NULL, dst.st_size, PROT_READ, MAP_PRIVATE, dfd, 0);
+		if (dp == MAP_FAILED)
+			err(1, "mmap");
+	}
+
+	if (isar(p, len))
+		error = ar_convert(p, len, path);
+	else if (iself(p, len))
+		error = elf_convert(p, len, dp, dp ? dst.st_size : 0);
+
+	if (dp != NULL)
+		munmap(dp, dst.st_size);
+
+	return error;
+}
+
+/*
+ * Open the separate debug file of the ELF file ``p'' if it has no debug
+ * sections.  It is looked for by build ID under ``debugdir'', then with
+ * the name in the .gnu_debuglink section next to the file, in its .debug
+ * directory and in the same directory under ``debugdir''.
+ */
+int
+debug_open(int fd, const char *p, size_t len, const char *path, char *dpath,
+    size_t dlen)
+{
+	struct stat		 st;
+	struct elf_index	*ei = NULL;
+	const uint8_t		*id;
+	const char		*link, *dir = ".", *sep;
+	size_t			 i, idlen, dirlen = 1;
+	uint32_t		 crc;
+	int			 n, dfd = -1;
+
+	dpath[0] = '\0';
+	if (fstat(fd, &st) == -1)
+		return -1;
+
+	if (len < SELFMAG || memcmp(p, ELFMAG, SELFMAG) != 0 || !iself(p, len))
+		goto out;
+	if ((ei = elf_index_init(p, len)) == NULL)
+		goto out;
+	if (elf_hassection(ei, DEBUG_INFO) != -1)
+		goto out;
+
+	if (elf_getbuildid(ei, &id, &idlen) != -1) {
+		n = snprintf(dpath, dlen, "%s/.build-id/%02x/", debugdir,
+		    id[0]);
+		for (i = 1; i < idlen && n >= 0 && (size_t)n < dlen; i++)
+			n += snprintf(dpath + n, dlen - n, "%02x", id[i]);
+		if (n >= 0 && strlcat(dpath, ".debug", dlen) < dlen &&
+		    (dfd = debug_try(dpath, &st, 0, 0)) != -1)
+			goto out;
+	}
+
+	if (elf_getdebuglink(ei, &link, &crc) != -1) {
+		if ((sep = strrchr(path, '/')) != NULL) {
+			dir = path;
+			dirlen = sep - path;
+		}
+		n = snprintf(dpath, dlen, "%.*s/%s", (int)dirlen, dir, link);
+		if (n >= 0 && (size_t)n < dlen &&
+		    (dfd = debug_try(dpath, &st, 1, crc)) != -1)
+			goto out;
+		n = snprintf(dpath, dlen, "%.*s/.debug/%s", (int)dirlen, dir,
+		    link);
+		if (n >= 0 && (size_t)n < dlen &&
+		    (dfd = debug_try(dpath, &st, 1, crc)) != -1)
+			goto out;
+		n = snprintf(dpath, dlen, "%s/%.*s/%s", debugdir, (int)dirlen,
+		    dir, link);
+		if (dir[0] == '/' && n >= 0 && (size_t)n < dlen &&
+		    (dfd = debug_try(dpath, &st, 1, crc)) != -1)
+			goto out;
+	}
+	dpath[0] = '\0';
+
+out:
+	elf_index_free(ei);
+	return dfd;
+}
+
+/*
+ * Open the debug file ``dpath'' if it is an ELF file other than the one
+ * described by ``ist'' and, if ``checkcrc'' is set, its CRC32 is ``crc''.
+ */
+int
+debug_try(const char *dpath, const struct stat *ist, int checkcrc,
+    uint32_t crc)
+{
+	struct stat		 st;
+	char			*p;
+	int			 dfd, valid;
+#ifdef ZLIB
+	uLong			 dcrc;
+	size_t			 off, len;
+#endif /* ZLIB */
+
+	dfd = open(dpath, O_RDONLY);
+	if (dfd == -1)
+		return -1;
+
+	if (fstat(dfd, &st) == -1 || (uintmax_t)st.st_size > SIZE_MAX ||
+	    st.st_size < SELFMAG ||
+	    (st.st_dev == ist->st_dev && st.st_ino == ist->st_ino)) {
+		close(dfd);
+		return -1;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, dfd, 0);
 	if (p == MAP_FAILED)
 		err(1, "mmap");
 
-	if (iself(p, st.st_size))
-		error = elf_convert(p, st.st_size);
+	valid = (memcmp(p, ELFMAG, SELFMAG) == 0 && iself(p, st.st_size));
+#ifdef ZLIB
+	if (valid && checkcrc) {
+		dcrc = crc32(0L, Z_NULL, 0);
+		for (off = 0; off < (size_t)st.st_size; off += len) {
+			len = MINIMUM(st.st_size - off, 1U << 30);
+			dcrc = crc32(dcrc, (const Bytef *)p + off, len);
+		}
+		if ((uint32_t)dcrc != crc) {
+			warnx("%s: CRC mismatch, ignored", dpath);
+			valid = 0;
+		}
+	}
+#endif /* ZLIB */
 
 	munmap(p, st.st_size);
+	if (!valid) {
+		close(dfd);
+		return -1;
+	}
 
-	return error;
+	return dfd;
+}
+
+/*
+ * Write a copy of the ELF file ``ip'' with the generated CTF data in
+ * its SUNW_ctf section.
+ */
+int
+embed(const char *ip, size_t isize, const char *ipath, int ofd,
+    const char *opath, int xfd, const char *xpath, int mfd, const char *mpath,
+    int bfd, const char *bpath, const char *label)
+{
+	struct elf_copy		*ec;
+	int			 error;
+
+	/* Archives are converted but there is no ELF file to copy. */
+	if (!iself(ip, isize)) {
+		warnx("%s: not an ELF file", ipath);
+		return 1;
+	}
+
+	ec = elf_copy_begin(ip, isize, btf ? BTF_SECTION : SUNW_CTF, strip,
+	    ofd, opath);
+	if (ec == NULL)
+		return 1;
+
+	if (btf)
+		error = btf_generate(ofd, opath);
+	else
+		error = generate(ofd, opath, xfd, xpath, mfd, mpath, bfd,
+		    bpath, label, zlevel);
+	return elf_copy_end(ec, error);
 }
 
 const char		*dstrbuf;
@@ -249,49 +797,122 @@ const char		*strtab;
 const Elf_Sym		*symtab;
 size_t			 strtabsz, nsymb;
 
+/* addresses of functions & objects, in the order of their sections */
+struct ctf_idxaddr	*funcaddrs, *objaddrs;
+size_t			 nfuncaddrs, nobjaddrs;
+
 int
-elf_convert(char *p, size_t filesize)
+elf_convert(const char *p, size_t filesize, const char *dp, size_t dsize)
 {
-	const char		*shstab;
+	struct elf_index	*ei, *dei;
 	const char		*infobuf, *abbuf;
 	size_t			 infolen, ablen;
-	size_t			 shstabsz;
+	int			 error = 1;
 
-	/* Find section header string table location and size. */
-	if (elf_getshstab(p, filesize, &shstab, &shstabsz))
+	/* Index the sections once for all lookups. */
+	if ((ei = elf_index_init(p, filesize)) == NULL)
 		return 1;
 
-	/* Find symbol table location and number of symbols. */
-	if (elf_getsymtab(p, filesize, shstab, shstabsz, &symtab, &nsymb) == -1)
-		warnx("symbol table not found");
+	/* Debug sections are read from the separate file, if any. */
+	dei = ei;
+	if (dp != NULL && (dei = elf_index_init(dp, dsize)) == NULL) {
+		elf_index_free(ei);
+		return 1;
+	}
 
-	/* Find string table location and size. */
-	if (elf_getsection(p, filesize, ELF_STRTAB, shstab, shstabsz, &strtab,
-	    &strtabsz) == -1)
-		warnx("string table not found");
+	/*
+	 * Find symbol table location and number of symbols, a fully
+	 * stripped file only has it in its separate debug file.
+	 */
+	if (elf_getsymtab(ei, &symtab, &nsymb) != -1) {
+		if (elf_getsection(ei, ELF_STRTAB, &strtab, &strtabsz) == -1)
+			warnx("string table not found");
+	} else if (elf_getsymtab(dei, &symtab, &nsymb) != -1) {
+		if (elf_getsection(dei, ELF_STRTAB, &strtab, &strtabsz) == -1)
+			warnx("string table not found");
+	} else
+		warnx("symbol table not found");
 
 	/* Find abbreviation location and size. */
-	if (elf_getsection(p, filesize, DEBUG_ABBREV, shstab, shstabsz, &abbuf,
-	    &ablen) == -1) {
+	if (elf_getsection(dei, DEBUG_ABBREV, &abbuf, &ablen) == -1) {
 		warnx("%s section not found", DEBUG_ABBREV);
-		return 1;
+		goto out;
 	}
 
-	if (elf_getsection(p, filesize, DEBUG_INFO, shstab, shstabsz, &infobuf,
-	    &infolen) == -1) {
+	if (elf_getsection(dei, DEBUG_INFO, &infobuf, &infolen) == -1) {
 		warnx("%s section not found", DEBUG_INFO);
-		return 1;
+		goto out;
 	}
 
 	/* Find string table location and size. */
-	if (elf_getsection(p, filesize, DEBUG_STR, shstab, shstabsz, &dstrbuf,
-	    &dstrlen) == -1)
+	if (elf_getsection(dei, DEBUG_STR, &dstrbuf, &dstrlen) == -1)
 		warnx("%s section not found", DEBUG_STR);
 
 	dwarf_parse(infobuf, infolen, abbuf, ablen);
 
 	/* Sort functions */
 	elf_sort();
+	error = 0;
+
+out:
+	/* Relocated sections are owned by the indexes. */
+	if (dei != ei)
+		elf_index_free(dei);
+	elf_index_free(ei);
+
+	/* Do not let the next archive member use the freed sections. */
+	symtab = NULL;
+	nsymb = 0;
+	strtab = NULL;
+	strtabsz = 0;
+	dstrbuf = NULL;
+	dstrlen = 0;
+
+	return error;
+}
+
+/*
+ * Merge the types of all the ELF members of the archive ``p'', parsed
+ * from the mapping.  Functions and objects are listed in the order of
+ * the members, then of their symbols.
+ */
+int
+ar_convert(const char *p, size_t filesize, const char *path)
+{
+	struct ar_iter		*ai;
+	const char		*name, *data;
+	char			*copy;
+	size_t			 namelen, size;
+	int			 r, nconv = 0;
+
+	ai = ar_open(p, filesize);
+	while ((r = ar_next(ai, &name, &namelen, &data, &size)) == 1) {
+		if (size < SELFMAG || memcmp(data, ELFMAG, SELFMAG) != 0)
+			continue;
+
+		/* Members are only aligned on 2 bytes. */
+		copy = NULL;
+		if ((uintptr_t)data % sizeof(uint64_t) != 0) {
+			copy = xmalloc(size);
+			memcpy(copy, data, size);
+			data = copy;
+		}
+
+		if (iself(data, size) && elf_convert(data, size, NULL, 0) == 0)
+			nconv++;
+		else
+			warnx("%s(%.*s): not converted", path, (int)namelen,
+			    name);
+		free(copy);
+	}
+	ar_close(ai);
+
+	if (r == -1)
+		return 1;
+	if (nconv == 0) {
+		warnx("%s: no ELF member to convert", path);
+		return 1;
+	}
 
 	return 0;
 }
@@ -331,8 +952,17 @@ void
 elf_sort(void)
 {
 	struct itype		*it, tmp;
+	struct ctf_idxaddr	*ia;
 	size_t			 i;
 
+	/* Archive members are sorted one after the other. */
+	if (nsymb > 0) {
+		funcaddrs = xreallocarray(funcaddrs, nfuncaddrs + nsymb,
+		    sizeof(*funcaddrs));
+		objaddrs = xreallocarray(objaddrs, nobjaddrs + nsymb,
+		    sizeof(*objaddrs));
+	}
+
 	memset(&tmp, 0, sizeof(tmp));
 	for (i = 0; i < nsymb; i++) {
 		const Elf_Sym	*st = &symtab[i];
@@ -372,10 +1002,19 @@ elf_sort(void)
 		it->it_ref = i;
 
 		it->it_flags |= ITF_INSERTED;
-		if (it->it_flags & ITF_FUNC)
+		if (ELF_ST_BIND(st->st_info) != STB_LOCAL)
+			it->it_flags |= ITF_GLOBAL;
+		if (it->it_flags & ITF_FUNC) {
+			ia = &funcaddrs[nfuncaddrs];
+			ia->ctia_index = nfuncaddrs++;
 			TAILQ_INSERT_TAIL(&ifuncq, it, it_symb);
-		else
+		} else {
+			ia = &objaddrs[nobjaddrs];
+			ia->ctia_index = nobjaddrs++;
 			TAILQ_INSERT_TAIL(&iobjq, it, it_symb);
+		}
+		ia->ctia_value = st->st_value;
+		ia->ctia_size = st->st_size;
 	}
 }
 
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _CTFIDX_H_
+#define _CTFIDX_H_
+
+/*
+ * Index of a CTF section, written by ctfconv(1) -i.
+ *
+ * The header is followed by ``cti_count'' entries for the named types,
+ * sorted by kind then by name so that a type can be looked up with a
+ * binary search.  Names are offsets in the string table of the
+ * corresponding CTF section.  Different types with the same kind and
+ * name have adjacent entries.
+ *
+ * Then come ``cti_nfuncs'' entries for the functions and ``cti_nobjs''
+ * entries for the data objects, sorted by symbol value, that give the
+ * position of their entry in the function or object section.
+ */
+
+#define CTF_IDX_MAGIC	0xcf1d
+#define CTF_IDX_VERSION	1
+
+struct ctf_idxhdr {
+	uint16_t	cti_magic;
+	uint8_t		cti_version;
+	uint8_t		cti_pad;
+	uint32_t	cti_count;	/* # of named types */
+	uint32_t	cti_strlen;	/* size of the CTF string table */
+	uint32_t	cti_nfuncs;	/* # of functions */
+	uint32_t	cti_nobjs;	/* # of data objects */
+	uint32_t	cti_reserved;
+};
+
+struct ctf_idxent {
+	uint32_t	ctie_name;	/* offset in the CTF string table */
+	uint16_t	ctie_kind;
+	uint16_t	ctie_type;	/* type ID */
+};
+
+struct ctf_idxaddr {
+	uint64_t	ctia_value;	/* symbol value */
+	uint64_t	ctia_size;	/* symbol size */
+	uint32_t	ctia_index;	/* position in its section */
+	uint32_t	ctia_pad;
+};
+
+#endif /* _CTFIDX_H_ */
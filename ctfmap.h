@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _CTFMAP_H_
+#define _CTFMAP_H_
+
+/*
+ * Uncompressed copy of a CTF section meant to be mapped, written by
+ * ctfconv(1) -m.
+ *
+ * The header is followed, at ``ctm_ctfoff'', by the CTF section with
+ * its header and without compression, then, at ``ctm_typesoff'', by
+ * ``ctm_ntypes'' 32-bit offsets of the types from the start of the
+ * section.  The first entry corresponds to the type ``ctm_firsttype''
+ * and the others to the following IDs.  Both parts start on a multiple
+ * of ``ctm_align'' so that they can be mapped separately.
+ */
+
+#define CTF_MAP_MAGIC	0xcf3a
+#define CTF_MAP_VERSION	1
+#define CTF_MAP_ALIGN	4096
+
+struct ctf_maphdr {
+	uint16_t	ctm_magic;
+	uint8_t		ctm_version;
+	uint8_t		ctm_pad;
+	uint32_t	ctm_align;	/* alignment of the parts */
+	uint32_t	ctm_ctfoff;	/* offset of the CTF section */
+	uint32_t	ctm_ctflen;	/* size of the CTF section */
+	uint32_t	ctm_typesoff;	/* offset of the type offsets */
+	uint32_t	ctm_ntypes;	/* # of type offsets */
+	uint32_t	ctm_firsttype;	/* ID of the first type */
+	uint32_t	ctm_reserved;
+};
+
+#endif /* _CTFMAP_H_ */
@@ -18,19 +18,189 @@
 
 #include <sys/types.h>
 #include <sys/elf.h>
+#include <sys/mman.h>
 
 #include <machine/reloc.h>
 
 #include <assert.h>
 #include <err.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include "xmalloc.h"
+#include "htab.h"
 
 #define ELF_SYMTAB	".symtab"
+#define ELF_BUILDID	".note.gnu.build-id"
+#define ELF_DEBUGLINK	".gnu_debuglink"
 #define Elf_RelA	__CONCAT(__CONCAT(Elf,__ELF_WORD_SIZE),_Rela)
 
-static int	elf_reloc_size(unsigned long);
-static void	elf_reloc_apply(const char *, size_t, const char *, size_t,
-		    ssize_t, char *, size_t);
+#ifndef ELF_R_INFO
+#define ELF_R_INFO	__CONCAT(__CONCAT(ELF,__ELF_WORD_SIZE),_R_INFO)
+#endif
+
+#ifndef SHF_INFO_LINK
+#define SHF_INFO_LINK	0x40
+#endif
+
+#ifndef NT_GNU_BUILD_ID
+#define NT_GNU_BUILD_ID	3
+#endif
+#ifndef ELF_NOTE_GNU
+#define ELF_NOTE_GNU	"GNU"
+#endif
+
+/* Relocations found in the debug sections of other architectures. */
+#ifndef EM_AARCH64
+#define EM_AARCH64		183
+#endif
+#ifndef EM_RISCV
+#define EM_RISCV		243
+#endif
+#ifndef R_AARCH64_ABS64
+#define R_AARCH64_ABS64		257
+#endif
+#ifndef R_AARCH64_ABS32
+#define R_AARCH64_ABS32		258
+#endif
+#ifndef R_AARCH64_ABS16
+#define R_AARCH64_ABS16		259
+#endif
+#ifndef R_RISCV_32
+#define R_RISCV_32		1
+#endif
+#ifndef R_RISCV_64
+#define R_RISCV_64		2
+#endif
+#ifndef R_RISCV_ADD8
+#define R_RISCV_ADD8		33
+#endif
+#ifndef R_RISCV_ADD16
+#define R_RISCV_ADD16		34
+#endif
+#ifndef R_RISCV_ADD32
+#define R_RISCV_ADD32		35
+#endif
+#ifndef R_RISCV_ADD64
+#define R_RISCV_ADD64		36
+#endif
+#ifndef R_RISCV_SUB8
+#define R_RISCV_SUB8		37
+#endif
+#ifndef R_RISCV_SUB16
+#define R_RISCV_SUB16		38
+#endif
+#ifndef R_RISCV_SUB32
+#define R_RISCV_SUB32		39
+#endif
+#ifndef R_RISCV_SUB64
+#define R_RISCV_SUB64		40
+#endif
+#ifndef R_RISCV_SET8
+#define R_RISCV_SET8		54
+#endif
+#ifndef R_RISCV_SET16
+#define R_RISCV_SET16		55
+#endif
+#ifndef R_RISCV_SET32
+#define R_RISCV_SET32		56
+#endif
+
+#define MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
+#define MAXIMUM(a, b)	(((a) > (b)) ? (a) : (b))
+#define ROUNDUP(x, y)	((((x) + (y) - 1) / (y)) * (y))
+
+#define ELF_SHDR(p, i)	\
+	((const Elf_Shdr *)((p) + ((Elf_Ehdr *)(p))->e_shoff +		\
+	    (i) * ((Elf_Ehdr *)(p))->e_shentsize))
+
+/*
+ * Copy of an ELF file with a section added or replaced.  Everything
+ * but the data of the section is written by elf_copy_begin(), the data
+ * is then appended by the caller and elf_copy_end() writes the section
+ * headers.
+ */
+struct elf_copy {
+	int		 ec_fd;
+	const char	*ec_path;
+	Elf_Ehdr	 ec_eh;		/* output ELF header */
+	Elf_Shdr	*ec_sh;		/* output section headers */
+	size_t		 ec_shnum;
+	size_t		 ec_sidx;	/* index of the added section */
+	off_t		 ec_off;	/* current output offset */
+};
+
+/*
+ * Sections of a mapped ELF file, indexed by name, and the relocation
+ * sections that apply to each of them.  Built once so that lookups do
+ * not scan all the section headers.
+ */
+struct elf_index {
+	const char	*ei_p;
+	size_t		 ei_filesize;
+	const char	*ei_shstab;
+	size_t		 ei_shstabsz;
+	struct htab	*ei_htab;	/* valid sections by name */
+	struct elf_sect	*ei_sects;	/* one per section header */
+	size_t		 ei_shnum;
+	ssize_t		 ei_symtab;	/* index of the symbol table */
+};
+
+struct elf_sect {
+	struct htab_entry es_key;	/* Must be first */
+	ssize_t		 es_rel;	/* first relocation section, or -1 */
+	ssize_t		 es_relnext;	/* next one for the same target */
+	int		 es_relocated;	/* relocations have been applied */
+	char		*es_data;	/* relocated copy of the section */
+};
+
+/*
+ * Consecutive relocations of a section applied by their own thread.
+ */
+struct elf_rchunk {
+	pthread_t	 rc_thread;
+	unsigned int	 rc_machine;
+	int		 rc_rela;	/* Elf_RelA entries */
+	const char	*rc_rels;
+	size_t		 rc_first;	/* first relocation of the chunk */
+	size_t		 rc_last;	/* first one of the next chunk */
+	const Elf_Sym	*rc_symtab;
+	size_t		 rc_nsymb;
+	char		*rc_sdata;	/* relocated section */
+	size_t		 rc_ssz;
+	int		 rc_threaded;	/* applied by rc_thread */
+};
+
+#define RELOC_CHUNK	(16 * 1024)	/* minimum # of relocations per chunk */
+
+#define RELOC_ABS	0		/* S + A */
+#define RELOC_ADD	1		/* location + S + A */
+#define RELOC_SUB	2		/* location - (S + A) */
+
+struct elf_range {
+	Elf_Off		 er_off;	/* offset in the input file */
+	size_t		 er_idx;	/* index in the input file */
+};
+
+static int	elf_reloc_type(unsigned int, unsigned long, int *);
+static uint64_t	elf_reloc_read(const char *, int);
+static void	elf_reloc_write(char *, uint64_t, int);
+static uint64_t	elf_reloc_offset(const struct elf_rchunk *, size_t);
+static void	*elf_reloc_chunk(void *);
+static void	elf_reloc_apply(struct elf_index *, ssize_t, char *, size_t);
+static void	elf_prefetch(const char *, size_t);
+static int	elf_write(struct elf_copy *, const void *, size_t);
+static int	elf_pad(struct elf_copy *, size_t);
+static int	elf_debug(const char *);
+static int	elf_range_cmp(const void *, const void *);
+static Elf_Sym	*elf_symtab_renum(const char *, const Elf_Shdr *,
+		    const size_t *, size_t, size_t *, size_t *);
+static int	elf_rel_renum(struct elf_copy *, const char *,
+		    const Elf_Shdr *, const size_t *, size_t);
+
+extern int	 njobs;
 
 int
 iself(const char *p, size_t filesize)
@@ -105,209 +275,1036 @@ elf_getshstab(const char *p, size_t filesize, const char **shstab,
 	return 0;
 }
 
-ssize_t
-elf_getsymtab(const char *p, size_t filesize, const char *shstab,
-    size_t shstabsz, const Elf_Sym **symtab, size_t *nsymb)
+/*
+ * Index the sections of the ELF file ``p'', which must have been checked
+ * with iself().  The file is only read: sections with relocations are
+ * copied when looked up and the copies are freed with the index.
+ */
+struct elf_index *
+elf_index_init(const char *p, size_t filesize)
 {
-	Elf_Ehdr	*eh = (Elf_Ehdr *)p;
-	Elf_Shdr	*sh;
-	size_t		 snlen;
-	ssize_t		 i;
+	const Elf_Ehdr		*eh = (const Elf_Ehdr *)p;
+	const Elf_Shdr		*sh;
+	struct elf_index	*ei;
+	struct elf_sect		*es;
+	const char		*name;
+	unsigned int		 slot;
+	size_t			 len;
+	ssize_t			 i;
 
-	snlen = strlen(ELF_SYMTAB);
+	ei = xcalloc(1, sizeof(*ei));
+	ei->ei_p = p;
+	ei->ei_filesize = filesize;
+	if (elf_getshstab(p, filesize, &ei->ei_shstab, &ei->ei_shstabsz)) {
+		free(ei);
+		return NULL;
+	}
 
-	for (i = 0; i < eh->e_shnum; i++) {
-		sh = (Elf_Shdr *)(p + eh->e_shoff + i * eh->e_shentsize);
+	ei->ei_shnum = eh->e_shnum;
+	ei->ei_sects = xcalloc(ei->ei_shnum + 1, sizeof(*ei->ei_sects));
+	ei->ei_htab = htab_init(6);
+	ei->ei_symtab = -1;
 
-		if (sh->sh_type != SHT_SYMTAB)
-			continue;
+	for (i = 0; i < (ssize_t)ei->ei_shnum; i++) {
+		sh = ELF_SHDR(p, i);
+		es = &ei->ei_sects[i];
+		es->es_rel = -1;
 
-		if ((sh->sh_link >= eh->e_shnum) || (sh->sh_name >= shstabsz))
+		if ((sh->sh_link >= ei->ei_shnum) ||
+		    (sh->sh_name >= ei->ei_shstabsz))
 			continue;
 
 		if ((sh->sh_offset + sh->sh_size) > filesize)
 			continue;
 
-		if (sh->sh_entsize == 0)
+		name = ei->ei_shstab + sh->sh_name;
+		len = strnlen(name, ei->ei_shstabsz - sh->sh_name);
+		if (len == ei->ei_shstabsz - sh->sh_name)
 			continue;
 
-		if (strncmp(shstab + sh->sh_name, ELF_SYMTAB, snlen) == 0) {
-			if (symtab != NULL)
-				*symtab = (Elf_Sym *)(p + sh->sh_offset);
-			if (nsymb != NULL)
-				*nsymb = (sh->sh_size / sh->sh_entsize);
+		/* The first section with a given name is used. */
+		if (htab_find(ei->ei_htab, name, len, &slot) == NULL)
+			htab_insert(ei->ei_htab, slot, &es->es_key, name, len);
 
-			return i;
-		}
+		if (ei->ei_symtab == -1 && sh->sh_type == SHT_SYMTAB &&
+		    sh->sh_entsize != 0 && strcmp(name, ELF_SYMTAB) == 0)
+			ei->ei_symtab = i;
 	}
 
-	return -1;
+	/* Chain relocation sections in order, from the last one. */
+	for (i = ei->ei_shnum - 1; i >= 0 && ei->ei_symtab != -1; i--) {
+		sh = ELF_SHDR(p, i);
+
+		if (sh->sh_type != SHT_REL && sh->sh_type != SHT_RELA)
+			continue;
+
+		if (sh->sh_size == 0)
+			continue;
+
+		if ((sh->sh_info >= ei->ei_shnum) ||
+		    (sh->sh_link != ei->ei_symtab))
+			continue;
+
+		if ((sh->sh_offset + sh->sh_size) > filesize)
+			continue;
+
+		es = &ei->ei_sects[sh->sh_info];
+		ei->ei_sects[i].es_relnext = es->es_rel;
+		es->es_rel = i;
+	}
+
+	return ei;
+}
+
+void
+elf_index_free(struct elf_index *ei)
+{
+	size_t			 i;
+
+	if (ei == NULL)
+		return;
+
+	for (i = 0; i < ei->ei_shnum; i++)
+		free(ei->ei_sects[i].es_data);
+	htab_free(ei->ei_htab);
+	free(ei->ei_sects);
+	free(ei);
 }
 
 ssize_t
-elf_getsection(char *p, size_t filesize, const char *sname, const char *shstab,
-    size_t shstabsz, const char **psdata, size_t *pssz)
+elf_getsymtab(struct elf_index *ei, const Elf_Sym **symtab, size_t *nsymb)
 {
-	Elf_Ehdr	*eh = (Elf_Ehdr *)p;
-	Elf_Shdr	*sh;
-	char		*sdata = NULL;
-	size_t		 snlen, ssz = 0;
-	ssize_t		 sidx, i;
+	const Elf_Shdr	*sh;
+
+	if (ei->ei_symtab == -1)
+		return -1;
+
+	sh = ELF_SHDR(ei->ei_p, ei->ei_symtab);
+	if (symtab != NULL)
+		*symtab = (const Elf_Sym *)(ei->ei_p + sh->sh_offset);
+	if (nsymb != NULL)
+		*nsymb = (sh->sh_size / sh->sh_entsize);
+
+	return ei->ei_symtab;
+}
+
+/*
+ * Look for the section ``sname'' without reading nor relocating it.
+ */
+ssize_t
+elf_hassection(struct elf_index *ei, const char *sname)
+{
+	struct elf_sect	*es;
+	size_t		 snlen;
 
 	snlen = strlen(sname);
 	if (snlen == 0)
 		return -1;
 
-	/* Find the given section. */
-	for (i = 0; i < eh->e_shnum; i++) {
-		if ((eh->e_shoff + i * eh->e_shentsize) > filesize)
-			continue;
+	es = (struct elf_sect *)htab_find(ei->ei_htab, sname, snlen, NULL);
+	if (es == NULL)
+		return -1;
 
-		sh = (Elf_Shdr *)(p + eh->e_shoff + i * eh->e_shentsize);
+	return es - ei->ei_sects;
+}
 
-		if ((sh->sh_link >= eh->e_shnum) || (sh->sh_name >= shstabsz))
-			continue;
+/*
+ * Return the section ``sname'' as stored in the file, its relocations
+ * are not applied.  See elf_getrelsection().
+ */
+ssize_t
+elf_getrawsection(struct elf_index *ei, const char *sname,
+    const char **psdata, size_t *pssz)
+{
+	const Elf_Shdr	*sh;
+	ssize_t		 sidx;
 
-		if ((sh->sh_offset + sh->sh_size) > filesize)
-			continue;
+	sidx = elf_hassection(ei, sname);
+	if (sidx == -1)
+		return -1;
 
-		if (strncmp(shstab + sh->sh_name, sname, snlen) == 0) {
-			sidx = i;
-			sdata = p + sh->sh_offset;
-			ssz = sh->sh_size;
-			elf_reloc_apply(p, filesize, shstab, shstabsz, sidx,
-			    sdata, ssz);
-			break;
-		}
-	}
+	sh = ELF_SHDR(ei->ei_p, sidx);
+	if (psdata != NULL)
+		*psdata = ei->ei_p + sh->sh_offset;
+	if (pssz != NULL)
+		*pssz = sh->sh_size;
 
-	if (sdata == NULL)
+	return sidx;
+}
+
+/*
+ * Return the relocation section following ``rel'', or the first one if
+ * ``rel'' is -1, that applies to section ``sidx''.  Its type is stored
+ * in ``ptype''.
+ */
+ssize_t
+elf_getrelsection(struct elf_index *ei, ssize_t sidx, ssize_t rel,
+    const char **prdata, size_t *prsz, uint32_t *ptype)
+{
+	const Elf_Shdr	*sh;
+
+	if (rel == -1)
+		rel = ei->ei_sects[sidx].es_rel;
+	else
+		rel = ei->ei_sects[rel].es_relnext;
+	if (rel == -1)
 		return -1;
 
+	sh = ELF_SHDR(ei->ei_p, rel);
+	if (prdata != NULL)
+		*prdata = ei->ei_p + sh->sh_offset;
+	if (prsz != NULL)
+		*prsz = sh->sh_size;
+	if (ptype != NULL)
+		*ptype = sh->sh_type;
+
+	return rel;
+}
+
+ssize_t
+elf_getsection(struct elf_index *ei, const char *sname, const char **psdata,
+    size_t *pssz)
+{
+	const Elf_Shdr	*sh;
+	struct elf_sect	*es;
+	const char	*sdata;
+	size_t		 snlen;
+	ssize_t		 sidx;
+
+	snlen = strlen(sname);
+	if (snlen == 0)
+		return -1;
+
+	es = (struct elf_sect *)htab_find(ei->ei_htab, sname, snlen, NULL);
+	if (es == NULL)
+		return -1;
+
+	sidx = es - ei->ei_sects;
+	sh = ELF_SHDR(ei->ei_p, sidx);
+	sdata = ei->ei_p + sh->sh_offset;
+
+	if (!es->es_relocated) {
+		elf_prefetch(sdata, sh->sh_size);
+		if (es->es_rel != -1 && sh->sh_size > 0) {
+			es->es_data = xmalloc(sh->sh_size);
+			memcpy(es->es_data, sdata, sh->sh_size);
+			elf_reloc_apply(ei, sidx, es->es_data, sh->sh_size);
+		}
+		es->es_relocated = 1;
+	}
+	if (es->es_data != NULL)
+		sdata = es->es_data;
+
 	if (psdata != NULL)
 		*psdata = sdata;
 	if (pssz != NULL)
-		*pssz = ssz;
+		*pssz = sh->sh_size;
 
 	return sidx;
 }
 
+/*
+ * Find the GNU build ID of the indexed file, used to name its separate
+ * debug file.
+ */
+ssize_t
+elf_getbuildid(struct elf_index *ei, const uint8_t **pid, size_t *plen)
+{
+	const char	*note;
+	size_t		 notesz, off = 0;
+	uint32_t	 nh[3];		/* namesz, descsz, type */
+	ssize_t		 sidx;
+
+	sidx = elf_getsection(ei, ELF_BUILDID, &note, &notesz);
+	if (sidx == -1)
+		return -1;
+
+	while (notesz - off >= sizeof(nh)) {
+		memcpy(nh, note + off, sizeof(nh));
+		off += sizeof(nh);
+		if (nh[0] > notesz - off ||
+		    ROUNDUP(nh[0], 4) + (size_t)nh[1] > notesz - off)
+			break;
+
+		if (nh[2] == NT_GNU_BUILD_ID && nh[0] == sizeof(ELF_NOTE_GNU) &&
+		    memcmp(note + off, ELF_NOTE_GNU, nh[0]) == 0 && nh[1] > 0) {
+			*pid = (const uint8_t *)note + off + ROUNDUP(nh[0], 4);
+			*plen = nh[1];
+			return sidx;
+		}
+		off += ROUNDUP(nh[0], 4) + ROUNDUP(nh[1], 4);
+		if (off > notesz)
+			break;
+	}
+
+	return -1;
+}
+
+/*
+ * Find the name and CRC32 of the separate debug file of the indexed
+ * file in its .gnu_debuglink section.
+ */
+ssize_t
+elf_getdebuglink(struct elf_index *ei, const char **pname, uint32_t *pcrc)
+{
+	const char	*link;
+	size_t		 linksz, len;
+	ssize_t		 sidx;
+
+	sidx = elf_getsection(ei, ELF_DEBUGLINK, &link, &linksz);
+	if (sidx == -1)
+		return -1;
+
+	/* The name is padded to 4 bytes and followed by the CRC. */
+	len = strnlen(link, linksz);
+	if (len == 0 || ROUNDUP(len + 1, 4) + sizeof(*pcrc) > linksz)
+		return -1;
+
+	*pname = link;
+	memcpy(pcrc, link + ROUNDUP(len + 1, 4), sizeof(*pcrc));
+
+	return sidx;
+}
+
+/*
+ * Tell the pager that the mapped section ``p'' is about to be read, so
+ * that it is paged in with large reads instead of one fault at a time.
+ */
+static void
+elf_prefetch(const char *p, size_t len)
+{
+	uintptr_t		 start, end;
+	size_t			 pgsz = getpagesize();
+
+	if (len == 0)
+		return;
+
+	start = (uintptr_t)p & ~(pgsz - 1);
+	end = (uintptr_t)p + len;
+	madvise((void *)start, end - start, MADV_WILLNEED);
+}
+
+/*
+ * Size and kind of the relocations of type ``type'' for ``machine'' that
+ * are found in debug sections, -1 if they are not supported.
+ */
 static int
-elf_reloc_size(unsigned long type)
+elf_reloc_type(unsigned int machine, unsigned long type, int *kind)
 {
-	switch (type) {
-#ifdef R_X86_64_64
-	case R_X86_64_64:
-		return sizeof(uint64_t);
-#endif
-#ifdef R_X86_64_32
-	case R_X86_64_32:
-		return sizeof(uint32_t);
-#endif
+	*kind = RELOC_ABS;
+
+	switch (machine) {
+	case EM_X86_64:
+		switch (type) {
+		case R_X86_64_64:
+			return sizeof(uint64_t);
+		case R_X86_64_32:
+		case R_X86_64_32S:
+			return sizeof(uint32_t);
+		}
+		break;
+	case EM_386:
+		switch (type) {
+		case R_386_32:
+			return sizeof(uint32_t);
+		}
+		break;
+	case EM_AARCH64:
+		switch (type) {
+		case R_AARCH64_ABS64:
+			return sizeof(uint64_t);
+		case R_AARCH64_ABS32:
+			return sizeof(uint32_t);
+		case R_AARCH64_ABS16:
+			return sizeof(uint16_t);
+		}
+		break;
+	case EM_RISCV:
+		/* Differences of labels are pairs of ADD and SUB. */
+		switch (type) {
+		case R_RISCV_64:
+			return sizeof(uint64_t);
+		case R_RISCV_32:
+		case R_RISCV_SET32:
+			return sizeof(uint32_t);
+		case R_RISCV_SET16:
+			return sizeof(uint16_t);
+		case R_RISCV_SET8:
+			return sizeof(uint8_t);
+		case R_RISCV_ADD64:
+		case R_RISCV_SUB64:
+			*kind = (type == R_RISCV_ADD64) ? RELOC_ADD : RELOC_SUB;
+			return sizeof(uint64_t);
+		case R_RISCV_ADD32:
+		case R_RISCV_SUB32:
+			*kind = (type == R_RISCV_ADD32) ? RELOC_ADD : RELOC_SUB;
+			return sizeof(uint32_t);
+		case R_RISCV_ADD16:
+		case R_RISCV_SUB16:
+			*kind = (type == R_RISCV_ADD16) ? RELOC_ADD : RELOC_SUB;
+			return sizeof(uint16_t);
+		case R_RISCV_ADD8:
+		case R_RISCV_SUB8:
+			*kind = (type == R_RISCV_ADD8) ? RELOC_ADD : RELOC_SUB;
+			return sizeof(uint8_t);
+		}
+		break;
+	default:
 #ifdef RELOC_32
-	case RELOC_32:
-		return sizeof(uint32_t);
+		if (machine == ELF_TARG_MACH && type == RELOC_32)
+			return sizeof(uint32_t);
 #endif
-	default:
 		break;
 	}
 
 	return -1;
 }
 
-#define ELF_WRITE_RELOC(buf, val, rsize)				\
-do {									\
-	if (rsize == 4) {						\
-		uint32_t v32 = val;					\
-		memcpy(buf, &v32, sizeof(v32));				\
-	} else {							\
-		uint64_t v64 = val;					\
-		memcpy(buf, &v64, sizeof(v64));				\
-	}								\
-} while (0)
+static uint64_t
+elf_reloc_read(const char *buf, int rsize)
+{
+	uint64_t	v64;
+	uint32_t	v32;
+	uint16_t	v16;
+	uint8_t		v8;
+
+	switch (rsize) {
+	case 1:
+		memcpy(&v8, buf, sizeof(v8));
+		return v8;
+	case 2:
+		memcpy(&v16, buf, sizeof(v16));
+		return v16;
+	case 4:
+		memcpy(&v32, buf, sizeof(v32));
+		return v32;
+	default:
+		memcpy(&v64, buf, sizeof(v64));
+		return v64;
+	}
+}
 
 static void
-elf_reloc_apply(const char *p, size_t filesize, const char *shstab,
-    size_t shstabsz, ssize_t sidx, char *sdata, size_t ssz)
+elf_reloc_write(char *buf, uint64_t val, int rsize)
 {
-	Elf_Ehdr	*eh = (Elf_Ehdr *)p;
-	Elf_Shdr	*sh;
-	Elf_Rel		*rel = NULL;
-	Elf_RelA	*rela = NULL;
-	const Elf_Sym	*symtab, *sym;
-	ssize_t		 symtabidx;
-	size_t		 nsymb, rsym, rtyp, roff;
-	size_t		 i, j;
-	uint64_t	 value;
-	int		 rsize;
-
-	/* Find symbol table location and number of symbols. */
-	symtabidx = elf_getsymtab(p, filesize, shstab, shstabsz, &symtab,
-	    &nsymb);
-	if (symtabidx == -1) {
-		warnx("symbol table not found");
-		return;
+	uint32_t	v32 = val;
+	uint16_t	v16 = val;
+	uint8_t		v8 = val;
+
+	switch (rsize) {
+	case 1:
+		memcpy(buf, &v8, sizeof(v8));
+		break;
+	case 2:
+		memcpy(buf, &v16, sizeof(v16));
+		break;
+	case 4:
+		memcpy(buf, &v32, sizeof(v32));
+		break;
+	default:
+		memcpy(buf, &val, sizeof(val));
+		break;
 	}
+}
 
-	/* Apply possible relocation. */
-	for (i = 0; i < eh->e_shnum; i++) {
-		if ((eh->e_shoff + i * eh->e_shentsize) > filesize)
+/*
+ * Apply the relocations [rc_first, rc_last) of a section.
+ */
+static void *
+elf_reloc_chunk(void *arg)
+{
+	struct elf_rchunk	*rc = arg;
+	const Elf_Rel		*rel;
+	const Elf_RelA		*rela;
+	const Elf_Sym		*sym;
+	size_t			 j, rsym, rtyp, roff;
+	uint64_t		 value, addend;
+	int			 rsize, kind;
+
+	for (j = rc->rc_first; j < rc->rc_last; j++) {
+		if (rc->rc_rela) {
+			rela = (const Elf_RelA *)rc->rc_rels + j;
+			rsym = ELF_R_SYM(rela->r_info);
+			rtyp = ELF_R_TYPE(rela->r_info);
+			roff = rela->r_offset;
+			addend = rela->r_addend;
+		} else {
+			rel = (const Elf_Rel *)rc->rc_rels + j;
+			rsym = ELF_R_SYM(rel->r_info);
+			rtyp = ELF_R_TYPE(rel->r_info);
+			roff = rel->r_offset;
+			addend = 0;
+		}
+		if (rsym >= rc->rc_nsymb)
 			continue;
 
-		sh = (Elf_Shdr *)(p + eh->e_shoff + i * eh->e_shentsize);
+		rsize = elf_reloc_type(rc->rc_machine, rtyp, &kind);
+		if (rsize == -1 || (size_t)rsize > rc->rc_ssz ||
+		    roff > rc->rc_ssz - rsize)
+			continue;
 
-		if (sh->sh_size == 0)
+		/* The addend of REL entries is in place. */
+		if (!rc->rc_rela)
+			addend = elf_reloc_read(rc->rc_sdata + roff, rsize);
+
+		sym = &rc->rc_symtab[rsym];
+		value = sym->st_value + addend;
+		if (kind == RELOC_ADD)
+			value += elf_reloc_read(rc->rc_sdata + roff, rsize);
+		else if (kind == RELOC_SUB)
+			value = elf_reloc_read(rc->rc_sdata + roff, rsize) -
+			    value;
+
+		elf_reloc_write(rc->rc_sdata + roff, value, rsize);
+	}
+
+	return NULL;
+}
+
+/*
+ * Apply the relocations of the section ``sidx'', whose data is ``sdata''.
+ * Large relocation sections are split in chunks applied by up to
+ * ``njobs'' threads.  Relocations of the same location are applied in
+ * order by the same thread, since ADD and SUB pairs depend on it.
+ */
+static void
+elf_reloc_apply(struct elf_index *ei, ssize_t sidx, char *sdata, size_t ssz)
+{
+	const Elf_Ehdr		*eh = (const Elf_Ehdr *)ei->ei_p;
+	const Elf_Shdr		*sh;
+	const Elf_Sym		*symtab;
+	struct elf_rchunk	*rcs, *rc;
+	size_t			 nsymb, nrels, esize, per, first, j;
+	ssize_t			 i;
+	int			 n, nchunks;
+
+	if (elf_getsymtab(ei, &symtab, &nsymb) == -1)
+		return;
+
+	rcs = xcalloc(MAXIMUM(njobs, 1), sizeof(*rcs));
+	for (i = ei->ei_sects[sidx].es_rel; i != -1;
+	    i = ei->ei_sects[i].es_relnext) {
+		sh = ELF_SHDR(ei->ei_p, i);
+		esize = (sh->sh_type == SHT_RELA) ?
+		    sizeof(Elf_RelA) : sizeof(Elf_Rel);
+		nrels = sh->sh_size / esize;
+		if (nrels == 0)
 			continue;
 
-		if ((sh->sh_info != sidx) || (sh->sh_link != symtabidx))
+		nchunks = MAXIMUM(njobs, 1);
+		if (nrels < (size_t)nchunks * RELOC_CHUNK)
+			nchunks = MAXIMUM(nrels / RELOC_CHUNK, 1);
+		per = nrels / nchunks;
+
+		for (n = 0, first = 0; n < nchunks && first < nrels; n++) {
+			rc = &rcs[n];
+			rc->rc_machine = eh->e_machine;
+			rc->rc_rela = (sh->sh_type == SHT_RELA);
+			rc->rc_rels = ei->ei_p + sh->sh_offset;
+			rc->rc_symtab = symtab;
+			rc->rc_nsymb = nsymb;
+			rc->rc_sdata = sdata;
+			rc->rc_ssz = ssz;
+			rc->rc_first = first;
+
+			/* Do not split relocations of the same location. */
+			j = (n == nchunks - 1) ? nrels : first + per;
+			while (j < nrels && j > first &&
+			    elf_reloc_offset(rc, j) == elf_reloc_offset(rc, j - 1))
+				j++;
+			rc->rc_last = j;
+			first = j;
+		}
+		nchunks = n;
+
+		/* The first chunk is applied by the calling thread. */
+		for (n = 1; n < nchunks; n++) {
+			rc = &rcs[n];
+			rc->rc_threaded = (pthread_create(&rc->rc_thread, NULL,
+			    elf_reloc_chunk, rc) == 0);
+			if (!rc->rc_threaded)
+				elf_reloc_chunk(rc);
+		}
+		elf_reloc_chunk(&rcs[0]);
+		for (n = 1; n < nchunks; n++) {
+			rc = &rcs[n];
+			if (rc->rc_threaded)
+				pthread_join(rc->rc_thread, NULL);
+			rc->rc_threaded = 0;
+		}
+	}
+	free(rcs);
+}
+
+static uint64_t
+elf_reloc_offset(const struct elf_rchunk *rc, size_t j)
+{
+	if (rc->rc_rela)
+		return ((const Elf_RelA *)rc->rc_rels)[j].r_offset;
+	return ((const Elf_Rel *)rc->rc_rels)[j].r_offset;
+}
+
+static int
+elf_write(struct elf_copy *ec, const void *data, size_t len)
+{
+	ssize_t		 n;
+	size_t		 off = 0;
+
+	while (off < len) {
+		n = write(ec->ec_fd, (const char *)data + off, len - off);
+		if (n == -1) {
+			warn("unable to write %zu bytes for %s", len - off,
+			    ec->ec_path);
+			return -1;
+		}
+		off += n;
+	}
+	ec->ec_off += len;
+
+	return 0;
+}
+
+/*
+ * Write zeros up to the next multiple of ``align''.
+ */
+static int
+elf_pad(struct elf_copy *ec, size_t align)
+{
+	static const char	 zeros[64];
+	size_t			 n;
+
+	if (align <= 1)
+		return 0;
+
+	n = (align - ec->ec_off % align) % align;
+	while (n > 0) {
+		if (elf_write(ec, zeros, MINIMUM(n, sizeof(zeros))))
+			return -1;
+		n -= MINIMUM(n, sizeof(zeros));
+	}
+
+	return 0;
+}
+
+/*
+ * Return 1 if ``name'' is the name of a debug section.
+ */
+static int
+elf_debug(const char *name)
+{
+	return (strncmp(name, ".debug", 6) == 0 ||
+	    strncmp(name, ".zdebug", 7) == 0);
+}
+
+static int
+elf_range_cmp(const void *a, const void *b)
+{
+	const struct elf_range *ra = a, *rb = b;
+
+	if (ra->er_off != rb->er_off)
+		return ra->er_off < rb->er_off ? -1 : 1;
+	return ra->er_idx < rb->er_idx ? -1 : 1;
+}
+
+/*
+ * Return a copy of the symbol table described by ``sh'' in which
+ * sections are numbered according to ``map'', with ``*pnsyms''
+ * symbols.  Like with "objcopy -g" the section symbols of removed
+ * sections are left out, ``smap'' maps the index of the symbols to
+ * their new one or 0 for those.  Other symbols defined in a removed
+ * section become absolute.
+ */
+static Elf_Sym *
+elf_symtab_renum(const char *p, const Elf_Shdr *sh, const size_t *map,
+    size_t shnum, size_t *smap, size_t *pnsyms)
+{
+	Elf_Sym		*syms;
+	size_t		 i, n, nsyms, shndx;
+
+	nsyms = sh->sh_size / sizeof(*syms);
+	syms = xreallocarray(NULL, nsyms, sizeof(*syms));
+
+	for (i = 0, n = 0; i < nsyms; i++) {
+		memcpy(&syms[n], p + sh->sh_offset + i * sizeof(*syms),
+		    sizeof(*syms));
+		smap[i] = n;
+		shndx = syms[n].st_shndx;
+		if (shndx == SHN_UNDEF || shndx >= SHN_LORESERVE ||
+		    shndx >= shnum) {
+			n++;
 			continue;
+		}
+		if (map[shndx] != 0)
+			syms[n].st_shndx = map[shndx];
+		else if (ELF_ST_TYPE(syms[n].st_info) == STT_SECTION &&
+		    ELF_ST_BIND(syms[n].st_info) == STB_LOCAL) {
+			smap[i] = 0;
+			continue;
+		} else {
+			syms[n].st_shndx = SHN_ABS;
+			syms[n].st_value = 0;
+		}
+		n++;
+	}
+	*pnsyms = n;
 
-		if ((sh->sh_offset + sh->sh_size) > filesize)
+	return syms;
+}
+
+/*
+ * Write the relocation section described by ``sh'' with its symbols
+ * numbered according to ``smap'', of ``nsyms'' entries.
+ */
+static int
+elf_rel_renum(struct elf_copy *ec, const char *p, const Elf_Shdr *sh,
+    const size_t *smap, size_t nsyms)
+{
+	Elf_Rel		 rel;
+	char		*rels;
+	size_t		 i, esize, sym;
+	int		 error;
+
+	if (sh->sh_size == 0)
+		return 0;
+
+	esize = (sh->sh_type == SHT_RELA) ? sizeof(Elf_RelA) : sizeof(Elf_Rel);
+	rels = xmalloc(sh->sh_size);
+	memcpy(rels, p + sh->sh_offset, sh->sh_size);
+
+	/* Elf_RelA only adds the addend after the fields of Elf_Rel. */
+	for (i = 0; i + esize <= sh->sh_size; i += esize) {
+		memcpy(&rel, rels + i, sizeof(rel));
+		sym = ELF_R_SYM(rel.r_info);
+		if (sym >= nsyms || (sym != 0 && smap[sym] == 0)) {
+			warnx("%s: bogus relocation symbol %zu", ec->ec_path,
+			    sym);
+			free(rels);
+			return -1;
+		}
+		rel.r_info = ELF_R_INFO(smap[sym], ELF_R_TYPE(rel.r_info));
+		memcpy(rels + i, &rel, sizeof(rel));
+	}
+
+	error = elf_write(ec, rels, sh->sh_size);
+	free(rels);
+
+	return error;
+}
+
+/*
+ * Start writing a copy of the ELF file ``p'' to ``fd'' in which the
+ * section ``sname'' is added or replaced.  If ``strip'' is set debug
+ * sections are left out.
+ *
+ * Parts of the file loaded at run time are copied as is, the other
+ * sections are written after them in the same order.  On success the
+ * data of ``sname'' can be written to ``fd'' before elf_copy_end() is
+ * called.
+ */
+struct elf_copy *
+elf_copy_begin(const char *p, size_t filesize, const char *sname, int strip,
+    int fd, const char *path)
+{
+	Elf_Ehdr		*eh = (Elf_Ehdr *)p;
+	const Elf_Phdr		*ph;
+	const Elf_Shdr		*sh;
+	struct elf_copy		*ec = NULL;
+	struct elf_range	*ranges = NULL;
+	Elf_Shdr		*osh;
+	Elf_Sym			*syms, *osyms = NULL;
+	const char		*shstab, *name;
+	char			*nstab = NULL;
+	size_t			*map = NULL, *smap = NULL;
+	size_t			 shstabsz, nstabsz, fixed;
+	size_t			 i, n, nranges, shnum = eh->e_shnum;
+	size_t			 symidx = 0, nsyms = 0, onsyms = 0;
+	int			 renum = 0, error;
+
+	if (elf_getshstab(p, filesize, &shstab, &shstabsz))
+		return NULL;
+	if (shnum == 0) {
+		warnx("%s: no section header", path);
+		return NULL;
+	}
+
+	/* Mark the sections to keep, relocations follow their target. */
+	map = xcalloc(shnum, sizeof(*map));
+	for (i = 1; i < shnum; i++) {
+		sh = ELF_SHDR(p, i);
+		if (sh->sh_name >= shstabsz ||
+		    memchr(shstab + sh->sh_name, '\0',
+		    shstabsz - sh->sh_name) == NULL) {
+			warnx("%s: bogus name for section %zu", path, i);
+			goto fail;
+		}
+		if (sh->sh_type != SHT_NOBITS &&
+		    (sh->sh_offset > filesize ||
+		    sh->sh_size > filesize - sh->sh_offset)) {
+			warnx("%s: bogus size for section %zu", path, i);
+			goto fail;
+		}
+		map[i] = !(strip && elf_debug(shstab + sh->sh_name));
+	}
+	for (i = 1; i < shnum; i++) {
+		sh = ELF_SHDR(p, i);
+		if ((sh->sh_type == SHT_REL || sh->sh_type == SHT_RELA) &&
+		    sh->sh_info > 0 && sh->sh_info < shnum &&
+		    map[sh->sh_info] == 0)
+			map[i] = 0;
+	}
+
+	ec = xcalloc(1, sizeof(*ec));
+	ec->ec_fd = fd;
+	ec->ec_path = path;
+	ec->ec_sh = xcalloc(shnum + 1, sizeof(*ec->ec_sh));
+
+	/*
+	 * Number the remaining sections, ``sname'' keeps its index.
+	 * Symbols of removed sections change even if others keep theirs.
+	 */
+	for (i = 1, n = 1; i < shnum; i++) {
+		if (map[i] == 0) {
+			renum = 1;
 			continue;
+		}
+		map[i] = n;
+		if (n != i)
+			renum = 1;
+		sh = ELF_SHDR(p, i);
+		if (strcmp(shstab + sh->sh_name, sname) == 0)
+			ec->ec_sidx = n;
+		ec->ec_sh[n++] = *sh;
+	}
+	if (ec->ec_sidx == 0)
+		ec->ec_sidx = n++;
+	ec->ec_shnum = n;
+	if (ec->ec_shnum >= SHN_LORESERVE) {
+		warnx("%s: too many sections", path);
+		goto fail;
+	}
 
-		switch (sh->sh_type) {
-		case SHT_RELA:
-			rela = (Elf_RelA *)(p + sh->sh_offset);
-			for (j = 0; j < (sh->sh_size / sizeof(Elf_RelA)); j++) {
-				rsym = ELF_R_SYM(rela[j].r_info);
-				rtyp = ELF_R_TYPE(rela[j].r_info);
-				roff = rela[j].r_offset;
-				if (rsym >= nsymb)
-					continue;
-				if (roff >= filesize)
-					continue;
-				sym = &symtab[rsym];
-				value = sym->st_value + rela[j].r_addend;
-
-				rsize = elf_reloc_size(rtyp);
-				if (rsize == -1 || roff + rsize >= ssz)
-					continue;
-
-				ELF_WRITE_RELOC(sdata + roff, value, rsize);
-			}
-			break;
-		case SHT_REL:
-			rel = (Elf_Rel *)(p + sh->sh_offset);
-			for (j = 0; j < (sh->sh_size / sizeof(Elf_Rel)); j++) {
-				rsym = ELF_R_SYM(rel[j].r_info);
-				rtyp = ELF_R_TYPE(rel[j].r_info);
-				roff = rel[j].r_offset;
-				if (rsym >= nsymb)
-					continue;
-				if (roff >= filesize)
-					continue;
-				sym = &symtab[rsym];
-				value = sym->st_value;
-
-				rsize = elf_reloc_size(rtyp);
-				if (rsize == -1 || roff + rsize >= ssz)
-					continue;
-
-				ELF_WRITE_RELOC(sdata + roff, value, rsize);
+	for (i = 1; i < shnum; i++) {
+		sh = ELF_SHDR(p, i);
+		if (map[i] == 0)
+			continue;
+		if (renum && (sh->sh_type == SHT_GROUP ||
+		    sh->sh_type == SHT_SYMTAB_SHNDX)) {
+			warnx("%s: cannot renumber sections", path);
+			goto fail;
+		}
+		osh = &ec->ec_sh[map[i]];
+		osh->sh_link = (sh->sh_link < shnum) ? map[sh->sh_link] : 0;
+		if (sh->sh_type == SHT_REL || sh->sh_type == SHT_RELA ||
+		    (sh->sh_flags & SHF_INFO_LINK))
+			osh->sh_info = (sh->sh_info < shnum) ?
+			    map[sh->sh_info] : 0;
+	}
+
+	/* New section header string table. */
+	nstabsz = 1 + strlen(sname) + 1;
+	for (i = 1; i < shnum; i++)
+		if (map[i] != 0)
+			nstabsz += strlen(shstab + ELF_SHDR(p, i)->sh_name) + 1;
+	nstab = xmalloc(nstabsz);
+	nstab[0] = '\0';
+	nstabsz = 1;
+	for (n = 1; n < ec->ec_shnum; n++) {
+		osh = &ec->ec_sh[n];
+		name = (n == ec->ec_sidx) ? sname : shstab + osh->sh_name;
+		i = strlen(name) + 1;
+		memcpy(nstab + nstabsz, name, i);
+		osh->sh_name = nstabsz;
+		nstabsz += i;
+	}
+
+	/* Everything loaded at run time stays at the same offset. */
+	fixed = eh->e_ehsize;
+	if (eh->e_phnum > 0) {
+		if (eh->e_phoff > filesize || eh->e_phentsize < sizeof(*ph) ||
+		    eh->e_phnum > (filesize - eh->e_phoff) / eh->e_phentsize) {
+			warnx("%s: bogus program header", path);
+			goto fail;
+		}
+		fixed = MAXIMUM(fixed,
+		    eh->e_phoff + eh->e_phnum * eh->e_phentsize);
+		for (i = 0; i < eh->e_phnum; i++) {
+			ph = (const Elf_Phdr *)(p + eh->e_phoff +
+			    i * eh->e_phentsize);
+			if (ph->p_offset > filesize ||
+			    ph->p_filesz > filesize - ph->p_offset) {
+				warnx("%s: bogus segment %zu", path, i);
+				goto fail;
 			}
+			fixed = MAXIMUM(fixed, ph->p_offset + ph->p_filesz);
+		}
+	}
+
+	ranges = xreallocarray(NULL, shnum, sizeof(*ranges));
+	for (i = 1, nranges = 0; i < shnum; i++) {
+		sh = ELF_SHDR(p, i);
+		if (map[i] == 0 || sh->sh_type == SHT_NOBITS)
+			continue;
+		ranges[nranges].er_off = sh->sh_offset;
+		ranges[nranges++].er_idx = i;
+	}
+	qsort(ranges, nranges, sizeof(*ranges), elf_range_cmp);
+
+	/* Sections overlapping the fixed part are part of it. */
+	for (i = 0; i < nranges; i++) {
+		sh = ELF_SHDR(p, ranges[i].er_idx);
+		if (sh->sh_offset >= fixed)
 			break;
-		default:
+		fixed = MAXIMUM(fixed, sh->sh_offset + sh->sh_size);
+	}
+
+	if (fixed > filesize) {
+		warnx("%s: bogus file size", path);
+		goto fail;
+	}
+
+	/* Relocations may be written before the symbols they refer to. */
+	for (n = 1; renum && n < shnum; n++) {
+		sh = ELF_SHDR(p, n);
+		if (map[n] == 0 || sh->sh_offset < fixed ||
+		    sh->sh_type != SHT_SYMTAB ||
+		    sh->sh_entsize != sizeof(*syms))
+			continue;
+		onsyms = sh->sh_size / sizeof(*syms);
+		smap = xcalloc(onsyms + 1, sizeof(*smap));
+		osyms = elf_symtab_renum(p, sh, map, shnum, smap, &nsyms);
+		symidx = n;
+		break;
+	}
+
+	if (elf_write(ec, p, fixed))
+		goto fail;
+
+	for (; i < nranges; i++) {
+		sh = ELF_SHDR(p, ranges[i].er_idx);
+		n = map[ranges[i].er_idx];
+		osh = &ec->ec_sh[n];
+		if (n == ec->ec_sidx || ranges[i].er_idx == eh->e_shstrndx)
+			continue;
+
+		if (elf_pad(ec, sh->sh_addralign))
+			goto fail;
+		osh->sh_offset = ec->ec_off;
+
+		if (symidx != 0 && ranges[i].er_idx == symidx) {
+			osh->sh_size = nsyms * sizeof(*syms);
+			osh->sh_info = (sh->sh_info < onsyms) ?
+			    smap[sh->sh_info] : nsyms;
+			error = elf_write(ec, osyms, osh->sh_size);
+		} else if (symidx != 0 && sh->sh_link == symidx &&
+		    (sh->sh_type == SHT_REL || sh->sh_type == SHT_RELA))
+			error = elf_rel_renum(ec, p, sh, smap, onsyms);
+		else
+			error = elf_write(ec, p + sh->sh_offset, sh->sh_size);
+		if (error)
+			goto fail;
+	}
+
+	/* Symbols of tables that are not moved cannot be renumbered. */
+	for (i = 1; renum && i < shnum; i++) {
+		sh = ELF_SHDR(p, i);
+		if (map[i] == 0 || sh->sh_offset >= fixed ||
+		    (sh->sh_type != SHT_SYMTAB && sh->sh_type != SHT_DYNSYM))
 			continue;
+		n = sh->sh_size / sizeof(*syms);
+		smap = xreallocarray(smap, n + 1, sizeof(*smap));
+		syms = elf_symtab_renum(p, sh, map, shnum, smap, &nsyms);
+		error = (nsyms != n ||
+		    memcmp(syms, p + sh->sh_offset, n * sizeof(*syms)));
+		free(syms);
+		if (error) {
+			warnx("%s: cannot renumber sections", path);
+			goto fail;
 		}
 	}
+
+	osh = &ec->ec_sh[map[eh->e_shstrndx]];
+	osh->sh_offset = ec->ec_off;
+	osh->sh_size = nstabsz;
+	if (elf_write(ec, nstab, nstabsz))
+		goto fail;
+
+	/* The section data is written by the caller. */
+	osh = &ec->ec_sh[ec->ec_sidx];
+	osh->sh_type = SHT_PROGBITS;
+	osh->sh_flags = 0;
+	osh->sh_addr = 0;
+	osh->sh_link = 0;
+	osh->sh_info = 0;
+	osh->sh_addralign = 4;
+	osh->sh_entsize = 0;
+	if (elf_pad(ec, osh->sh_addralign))
+		goto fail;
+	osh->sh_offset = ec->ec_off;
+
+	ec->ec_eh = *eh;
+	ec->ec_eh.e_shstrndx = map[eh->e_shstrndx];
+
+	free(osyms);
+	free(smap);
+	free(ranges);
+	free(nstab);
+	free(map);
+	return ec;
+
+fail:
+	if (ec != NULL)
+		free(ec->ec_sh);
+	free(ec);
+	free(osyms);
+	free(smap);
+	free(ranges);
+	free(nstab);
+	free(map);
+	return NULL;
+}
+
+/*
+ * Terminate the copy started by elf_copy_begin() unless ``error'' is
+ * set, and release ``ec''.
+ */
+int
+elf_copy_end(struct elf_copy *ec, int error)
+{
+	Elf_Shdr	*osh;
+	off_t		 end;
+
+	if (error)
+		goto out;
+
+	/* The section ends where the caller stopped writing. */
+	end = lseek(ec->ec_fd, 0, SEEK_CUR);
+	if (end == -1) {
+		warn("lseek %s", ec->ec_path);
+		error = -1;
+		goto out;
+	}
+	osh = &ec->ec_sh[ec->ec_sidx];
+	osh->sh_size = end - osh->sh_offset;
+	ec->ec_off = end;
+
+	error = -1;
+	if (elf_pad(ec, sizeof(Elf_Off)))
+		goto out;
+	ec->ec_eh.e_shoff = ec->ec_off;
+	ec->ec_eh.e_shentsize = sizeof(Elf_Shdr);
+	ec->ec_eh.e_shnum = ec->ec_shnum;
+	if (elf_write(ec, ec->ec_sh, ec->ec_shnum * sizeof(Elf_Shdr)))
+		goto out;
+
+	if (pwrite(ec->ec_fd, &ec->ec_eh, sizeof(ec->ec_eh), 0) !=
+	    sizeof(ec->ec_eh)) {
+		warn("unable to write ELF header for %s", ec->ec_path);
+		goto out;
+	}
+	error = 0;
+
+out:
+	free(ec->ec_sh);
+	free(ec);
+	return error;
 }
@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <err.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stddef.h>
@@ -36,9 +37,14 @@
 
 #include "itype.h"
 #include "xmalloc.h"
-#include "hash.h"
+#include "htab.h"
+#include "ctfidx.h"
+#include "ctfmap.h"
+#include "ctfblk.h"
 
 #define ROUNDUP(x, y) ((((x) + (y) - 1) / (y)) * (y))
+#define MAXIMUM(a, b)	(((a) > (b)) ? (a) : (b))
+#define MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
 
 /*
  * Dynamic buffer, used for content & string table.
@@ -49,38 +55,158 @@ struct dbuf {
 
 	char		*cptr; /* position in [data, data + size] */
 	size_t		 coff; /* number of written bytes */
+
+	struct sink	*sink; /* if set, where full buffers are drained */
+	size_t		 doff; /* number of drained bytes */
 };
 
 #define DBUF_CHUNKSZ	(64 * 1024)
 
+/*
+ * Output file, optionally deflated, written in chunks.
+ */
+struct sink {
+	int		 sk_fd;
+	const char	*sk_path;
+	char		*sk_buf;	/* pending output */
+	size_t		 sk_len;	/* # of pending bytes */
+	int		 sk_error;
+#ifdef ZLIB
+	int		 sk_compress;	/* deflate written data */
+	z_stream	 sk_zs;
+
+	/* Parallel deflate, used if sk_njobs > 1 */
+	int		 sk_njobs;
+	int		 sk_level;
+	struct pzblock	*sk_blocks;	/* blocks of the current batch */
+	int		 sk_nblocks;	/* # of complete blocks */
+	char		*sk_dict;	/* tail of the previous batch */
+	size_t		 sk_dictlen;
+	unsigned long	 sk_check;	/* adler32 of the data so far */
+#endif /* ZLIB */
+};
+
+#define SINK_BUFSZ	(256 * 1024)
+
+/*
+ * Consecutive types serialized by their own thread.  The layout of
+ * the string table is known beforehand and each type has a fixed
+ * size, so shards can be written independently and concatenated.
+ */
+struct tshard {
+	pthread_t	 ts_thread;
+	struct imcs	*ts_imcs;	/* shared string table */
+	struct itype	*ts_first;	/* first type of the shard */
+	struct itype	*ts_end;	/* first type of the next shard */
+	size_t		 ts_size;	/* # of bytes of the shard */
+	struct dbuf	 ts_body;
+	int		 ts_threaded;	/* serialized by ts_thread */
+};
+
+#define TSHARD_SIZE	(256 * 1024)
+
+#ifdef ZLIB
+/*
+ * Block of input deflated by its own thread.  Blocks are primed with
+ * the end of the previous one so that the concatenation of their raw
+ * deflate output is a single stream, framed by sink_deflate_init() and
+ * sink_finish().
+ */
+struct pzblock {
+	pthread_t	 pb_thread;
+	const char	*pb_dict;	/* preceding input */
+	size_t		 pb_dictlen;
+	char		*pb_in;
+	size_t		 pb_inlen;
+	char		*pb_out;
+	size_t		 pb_outlen;
+	unsigned long	 pb_check;	/* adler32 of the input */
+	int		 pb_level;
+	int		 pb_last;	/* terminates the stream */
+	int		 pb_threaded;	/* deflated by pb_thread */
+	int		 pb_error;
+};
+
+#define PZ_BLOCKSZ	(128 * 1024)
+#define PZ_DICTSZ	(32 * 1024)
+
+/*
+ * Part of the section compressed as an independent zlib stream, see
+ * ctfblk.h.
+ */
+struct zblock {
+	pthread_t	 zb_thread;
+	const char	*zb_in;
+	char		*zb_out;
+	uLongf		 zb_outlen;
+	int		 zb_level;
+	int		 zb_threaded;	/* compressed by zb_thread */
+	int		 zb_error;
+	struct ctf_blkent zb_ent;
+};
+
+#define ZAUTO_MINSZ	(16 * 1024)	/* smaller sections are not deflated */
+#define ZAUTO_SAMPLESZ	(64 * 1024)
+#endif /* ZLIB */
+
+extern int	 njobs;
+extern char	*parlabel, *parname;
+
+extern struct ctf_idxaddr	*funcaddrs, *objaddrs;
+extern size_t			 nfuncaddrs, nobjaddrs;
+
 /* In-memory representation of a CTF section. */
 struct imcs {
 	struct dbuf	 body;
 	struct dbuf	 stab;	/* corresponding string table */
-	struct hash	*htab;	/* hash table of known strings */
+	struct htab	*htab;	/* hash table of known strings */
+	size_t		 nstr;	/* # of strings in htab */
 };
 
 struct strentry {
-	struct hash_entry se_key;	/* Must be first */
+	struct htab_entry se_key;	/* Must be first */
 #define se_str se_key.hkey
+#define se_len se_key.hlen
 	size_t		 se_off;
 };
 
+void		 sink_init(struct sink *, int, const char *);
 #ifdef ZLIB
-char		*data_compress(const char *, size_t, off_t, size_t *);
+int		 sink_deflate_init(struct sink *, int, int);
 #endif /* ZLIB */
+void		 sink_write(struct sink *, const void *, size_t);
+void		 sink_zero(struct sink *, size_t);
+int		 sink_finish(struct sink *);
 
 void
 dbuf_realloc(struct dbuf *dbuf, size_t len)
 {
+	size_t size;
+
 	assert(dbuf != NULL);
 	assert(len != 0);
 
-	dbuf->data = xrealloc(dbuf->data, dbuf->size + len);
-	dbuf->size += len;
+	/* Grow geometrically to keep appends amortized linear. */
+	size = MAXIMUM(dbuf->size * 2, dbuf->size + len);
+
+	dbuf->data = xrealloc(dbuf->data, size);
+	dbuf->size = size;
 	dbuf->cptr = dbuf->data + dbuf->coff;
 }
 
+/*
+ * Push the buffered bytes of ``dbuf'' to its sink and rewind it.
+ */
+void
+dbuf_drain(struct dbuf *dbuf)
+{
+	assert(dbuf->sink != NULL);
+
+	sink_write(dbuf->sink, dbuf->data, dbuf->coff - dbuf->doff);
+	dbuf->doff = dbuf->coff;
+	dbuf->cptr = dbuf->data;
+}
+
 void
 dbuf_copy(struct dbuf *dbuf, void const *data, size_t len)
 {
@@ -93,8 +219,16 @@ dbuf_copy(struct dbuf *dbuf, void const *data, size_t len)
 	if (len == 0)
 		return;
 
-	left = dbuf->size - dbuf->coff;
-	if (left < (off_t)len)
+	left = dbuf->size - (dbuf->coff - dbuf->doff);
+	if (left < (off_t)len && dbuf->sink != NULL) {
+		dbuf_drain(dbuf);
+		if (dbuf->size < len) {
+			sink_write(dbuf->sink, data, len);
+			dbuf->coff += len;
+			dbuf->doff = dbuf->coff;
+			return;
+		}
+	} else if (left < (off_t)len)
 		dbuf_realloc(dbuf, ROUNDUP((len - left), DBUF_CHUNKSZ));
 
 	memcpy(dbuf->cptr, data, len);
@@ -117,21 +251,211 @@ size_t
 imcs_add_string(struct imcs *imcs, const char *str)
 {
 	struct strentry *se;
-	unsigned int slot;
 
 	if (str == NULL || *str == '\0')
 		return 0;
 
-	se = (struct strentry *)hash_find(imcs->htab, str, &slot);
-	if (se == NULL) {
-		se = xmalloc(sizeof(*se));
-		hash_insert(imcs->htab, slot, &se->se_key, str);
-		se->se_off = imcs->stab.coff;
+	se = (struct strentry *)htab_find(imcs->htab, str, strlen(str), NULL);
+	assert(se != NULL);	/* All strings are known after imcs_size(). */
+
+	return se->se_off;
+}
+
+/*
+ * Register ``str'' in the string table.
+ */
+void
+imcs_size_string(struct imcs *imcs, const char *str)
+{
+	struct strentry *se;
+	unsigned int slot;
+	size_t len;
+
+	if (str == NULL || *str == '\0')
+		return;
+
+	len = strlen(str);
+	se = (struct strentry *)htab_find(imcs->htab, str, len, &slot);
+	if (se != NULL)
+		return;
+
+	se = xmalloc(sizeof(*se));
+	htab_insert(imcs->htab, slot, &se->se_key, str, len);
+	se->se_off = 0;
+	imcs->nstr++;
+}
 
-		dbuf_copy(&imcs->stab, str, strlen(str) + 1);
+/*
+ * Compare two strings starting from their last character.
+ */
+static int
+strentry_rcmp(const void *a, const void *b)
+{
+	const struct strentry *sa = *(const struct strentry **)a;
+	const struct strentry *sb = *(const struct strentry **)b;
+	const unsigned char *pa, *pb;
+	size_t n;
+
+	pa = (const unsigned char *)sa->se_str + sa->se_len;
+	pb = (const unsigned char *)sb->se_str + sb->se_len;
+	for (n = MINIMUM(sa->se_len, sb->se_len); n > 0; n--) {
+		if (*--pa != *--pb)
+			return *pa - *pb;
 	}
 
-	return se->se_off;
+	return (sa->se_len > sb->se_len) - (sa->se_len < sb->se_len);
+}
+
+/*
+ * Assign an offset to every known string, placing strings that are a
+ * suffix of another one inside it, and return the size of the table.
+ *
+ * Once sorted by reversed content, the strings ending with a given one
+ * directly follow it, so walking them backward only requires checking
+ * the last string that got placed.
+ */
+size_t
+imcs_strtab_layout(struct imcs *imcs)
+{
+	struct strentry **sev, *se, *prev = NULL;
+	size_t i, off = 1;	/* empty string */
+	unsigned int pos;
+
+	if (imcs->nstr == 0)
+		return off;
+
+	sev = xreallocarray(NULL, imcs->nstr, sizeof(*sev));
+	i = 0;
+	for (se = htab_first(imcs->htab, &pos); se != NULL;
+	    se = htab_next(imcs->htab, &pos))
+		sev[i++] = se;
+	assert(i == imcs->nstr);
+
+	qsort(sev, imcs->nstr, sizeof(*sev), strentry_rcmp);
+
+	for (i = imcs->nstr; i-- > 0;) {
+		se = sev[i];
+		if (prev != NULL && se->se_len <= prev->se_len &&
+		    memcmp(prev->se_str + prev->se_len - se->se_len,
+		    se->se_str, se->se_len) == 0) {
+			se->se_off = prev->se_off + prev->se_len - se->se_len;
+			continue;
+		}
+
+		se->se_off = off;
+		off += se->se_len + 1;
+		prev = se;
+	}
+
+	free(sev);
+
+	return off;
+}
+
+/*
+ * Number of bytes imcs_add_func() writes for ``it''.
+ */
+size_t
+imcs_func_size(struct itype *it)
+{
+	if (it->it_type == CTF_K_UNKNOWN)
+		return sizeof(uint16_t);
+
+	return (2 + it->it_nelems) * sizeof(uint16_t);
+}
+
+/*
+ * Number of bytes imcs_add_type() writes for ``it''.
+ */
+size_t
+imcs_type_size(struct itype *it)
+{
+	size_t			 ctsz;
+	uint32_t		 size = it->it_size;
+	int			 kind = it->it_type, vlen = it->it_nelems;
+
+	if (it->it_refp != NULL && kind != CTF_K_ARRAY)
+		ctsz = sizeof(struct ctf_stype);
+	else if (size <= CTF_MAX_SIZE)
+		ctsz = sizeof(struct ctf_stype);
+	else
+		ctsz = sizeof(struct ctf_type);
+
+	switch (kind) {
+	case CTF_K_INTEGER:
+	case CTF_K_FLOAT:
+		ctsz += sizeof(unsigned int);
+		break;
+	case CTF_K_ARRAY:
+		ctsz += sizeof(struct ctf_array);
+		break;
+	case CTF_K_STRUCT:
+	case CTF_K_UNION:
+		if (size < CTF_LSTRUCT_THRESH)
+			ctsz += vlen * sizeof(struct ctf_member);
+		else
+			ctsz += vlen * sizeof(struct ctf_lmember);
+		break;
+	case CTF_K_FUNCTION:
+		ctsz += (vlen + (vlen & 1)) * sizeof(uint16_t);
+		break;
+	case CTF_K_ENUM:
+		ctsz += vlen * sizeof(struct ctf_enum);
+		break;
+	default:
+		break;
+	}
+
+	return ctsz;
+}
+
+/*
+ * Walk the type graph in emission order to compute the exact layout
+ * of the body and the size of the string table, so that the header is
+ * known before anything is written.  The string offsets are assigned
+ * here as well.
+ */
+void
+imcs_size(struct imcs *imcs, struct ctf_header *cth, const char *label)
+{
+	struct itype		*it;
+	struct imember		*im;
+	size_t			 bodysz;
+
+	imcs_size_string(imcs, label);
+	cth->cth_lbloff = 0;
+	bodysz = sizeof(struct ctf_lblent);
+
+	cth->cth_objtoff = bodysz = ROUNDUP(bodysz, 2);
+	TAILQ_FOREACH(it, &iobjq, it_symb)
+		bodysz += sizeof(uint16_t);
+
+	cth->cth_funcoff = bodysz = ROUNDUP(bodysz, 2);
+	TAILQ_FOREACH(it, &ifuncq, it_symb)
+		bodysz += imcs_func_size(it);
+
+	cth->cth_typeoff = bodysz = ROUNDUP(bodysz, 4);
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+			continue;
+
+		bodysz += imcs_type_size(it);
+
+		imcs_size_string(imcs, it_name(it));
+		switch (it->it_type) {
+		case CTF_K_STRUCT:
+		case CTF_K_UNION:
+		case CTF_K_ENUM:
+			TAILQ_FOREACH(im, &it->it_members, im_next)
+				imcs_size_string(imcs, im_name(im));
+			break;
+		default:
+			break;
+		}
+	}
+
+	cth->cth_stroff = bodysz;
+	cth->cth_strlen = imcs_strtab_layout(imcs);
 }
 
 void
@@ -284,172 +608,922 @@ imcs_add_type(struct imcs *imcs, struct itype *it)
 	}
 }
 
+/*
+ * Compute the layout of the CTF section described by ``cth'' and build
+ * its string table.
+ */
 void
-imcs_generate(struct imcs *imcs, struct ctf_header *cth, const char *label)
+imcs_init(struct imcs *imcs, struct ctf_header *cth, const char *label)
 {
-	struct itype		*it;
-	struct ctf_lblent	 lbl;
+	struct strentry		*se;
+	unsigned int		 pos;
 
 	memset(imcs, 0, sizeof(*imcs));
 
-	dbuf_realloc(&imcs->body, DBUF_CHUNKSZ);
-	dbuf_realloc(&imcs->stab, DBUF_CHUNKSZ);
+	imcs->htab = htab_init(10);
+
+	imcs_size_string(imcs, parlabel);
+	imcs_size_string(imcs, parname);
+	imcs_size(imcs, cth, label);
 
-	imcs->htab = hash_init(10);
-	if (imcs->htab == NULL)
-		err(1, "hash_init");
+	cth->cth_parlabel = imcs_add_string(imcs, parlabel);
+	cth->cth_parname = imcs_add_string(imcs, parname);
 
-	/* Add empty string */
-	dbuf_copy(&imcs->stab, "", 1);
+	dbuf_realloc(&imcs->stab, cth->cth_strlen);
 
-	/* We don't use parent label */
-	cth->cth_parlabel = 0;
-	cth->cth_parname = 0;
+	/* Lay out the string table, starting with the empty string. */
+	imcs->stab.data[0] = '\0';
+	for (se = htab_first(imcs->htab, &pos); se != NULL;
+	    se = htab_next(imcs->htab, &pos))
+		memcpy(imcs->stab.data + se->se_off, se->se_str,
+		    se->se_len + 1);
+	imcs->stab.coff = cth->cth_strlen;
+	imcs->stab.cptr = imcs->stab.data + cth->cth_strlen;
+}
+
+static void *
+tshard_add(void *arg)
+{
+	struct tshard		*ts = arg;
+	struct imcs		 imcs;
+	struct itype		*it;
+
+	/* Write in a private buffer, strings are only looked up. */
+	imcs = *ts->ts_imcs;
+	memset(&imcs.body, 0, sizeof(imcs.body));
+	if (ts->ts_size > 0)
+		dbuf_realloc(&imcs.body, ts->ts_size);
+
+	for (it = ts->ts_first; it != ts->ts_end;
+	    it = TAILQ_NEXT(it, it_next)) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+			continue;
+
+		imcs_add_type(&imcs, it);
+	}
+	assert(imcs.body.coff == ts->ts_size);
+
+	ts->ts_body = imcs.body;
+	return NULL;
+}
+
+/*
+ * Append the types to the body of ``imcs''.  With more than one job
+ * they are serialized in parallel, in batches of ``njobs'' shards
+ * written in order.
+ */
+void
+imcs_add_types(struct imcs *imcs)
+{
+	struct tshard		*shards, *ts;
+	struct itype		*it;
+	int			 i, n;
+
+	if (njobs <= 1) {
+		TAILQ_FOREACH(it, &itypeq, it_next) {
+			if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+				continue;
+
+			imcs_add_type(imcs, it);
+		}
+		return;
+	}
+
+	shards = xcalloc(njobs, sizeof(*shards));
+	it = TAILQ_FIRST(&itypeq);
+	while (it != NULL) {
+		for (n = 0; n < njobs && it != NULL; n++) {
+			ts = &shards[n];
+			ts->ts_imcs = imcs;
+			ts->ts_first = it;
+			ts->ts_size = 0;
+			for (; it != NULL && ts->ts_size < TSHARD_SIZE;
+			    it = TAILQ_NEXT(it, it_next)) {
+				if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+					continue;
+
+				ts->ts_size += imcs_type_size(it);
+			}
+			ts->ts_end = it;
+		}
+
+		/* The first shard is serialized by the calling thread. */
+		for (i = 1; i < n; i++) {
+			ts = &shards[i];
+			ts->ts_threaded = (pthread_create(&ts->ts_thread, NULL,
+			    tshard_add, ts) == 0);
+			if (!ts->ts_threaded)
+				tshard_add(ts);
+		}
+		tshard_add(&shards[0]);
+
+		for (i = 0; i < n; i++) {
+			ts = &shards[i];
+			if (ts->ts_threaded)
+				pthread_join(ts->ts_thread, NULL);
+			dbuf_copy(&imcs->body, ts->ts_body.data,
+			    ts->ts_body.coff);
+			free(ts->ts_body.data);
+		}
+	}
+	free(shards);
+}
+
+/*
+ * Write the body of the CTF section laid out by imcs_init().  If ``sink''
+ * is not NULL the body is streamed to it followed by the string table,
+ * otherwise it is kept in ``imcs->body''.
+ */
+void
+imcs_generate(struct imcs *imcs, struct ctf_header *cth, const char *label,
+    struct sink *sink)
+{
+	struct itype		*it;
+	struct ctf_lblent	 lbl;
+	size_t			 off;
+
+	imcs->body.sink = sink;
+	if (sink != NULL)
+		dbuf_realloc(&imcs->body, DBUF_CHUNKSZ);
+	else
+		dbuf_realloc(&imcs->body, cth->cth_stroff);
 
 	/* Insert a single label for all types. */
-	cth->cth_lbloff = 0;
 	lbl.ctl_label = imcs_add_string(imcs, label);
 	lbl.ctl_typeidx = tidx;
 	dbuf_copy(&imcs->body, &lbl, sizeof(lbl));
 
 	/* Insert objects */
-	cth->cth_objtoff = dbuf_pad(&imcs->body, 2);
+	off = dbuf_pad(&imcs->body, 2);
+	assert(off == cth->cth_objtoff);
 	TAILQ_FOREACH(it, &iobjq, it_symb)
 		imcs_add_obj(imcs, it);
 
 	/* Insert functions */
-	cth->cth_funcoff = dbuf_pad(&imcs->body, 2);
+	off = dbuf_pad(&imcs->body, 2);
+	assert(off == cth->cth_funcoff);
 	TAILQ_FOREACH(it, &ifuncq, it_symb)
 		imcs_add_func(imcs, it);
 
 	/* Insert types */
-	cth->cth_typeoff = dbuf_pad(&imcs->body, 4);
+	off = dbuf_pad(&imcs->body, 4);
+	assert(off == cth->cth_typeoff);
+	imcs_add_types(imcs);
+
+	assert(imcs->body.coff == cth->cth_stroff);
+
+	/* String table is written from its own buffer. */
+	if (sink != NULL) {
+		dbuf_drain(&imcs->body);
+		sink_write(sink, imcs->stab.data, imcs->stab.coff);
+	}
+}
+
+#ifdef ZLIB
+/*
+ * Choose a compression level for the section laid out in ``imcs'' from
+ * how well a sample of its types deflates at both ends of the scale.
+ * Sizes are compared rather than timings to keep the output stable.
+ */
+int
+zlevel_auto(struct imcs *imcs, struct ctf_header *cth)
+{
+	struct imcs		 sample;
+	struct itype		*it;
+	unsigned char		*zbuf;
+	uLongf			 zlen1, zlen9;
+	uLong			 bound;
+
+	if (cth->cth_stroff + cth->cth_strlen < ZAUTO_MINSZ)
+		return 0;
+
+	/* Serialize the first types, sharing the string table. */
+	sample = *imcs;
+	memset(&sample.body, 0, sizeof(sample.body));
+	dbuf_realloc(&sample.body, ZAUTO_SAMPLESZ);
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+			continue;
+		if (sample.body.coff + imcs_type_size(it) > ZAUTO_SAMPLESZ)
+			break;
+		imcs_add_type(&sample, it);
+	}
+	if (sample.body.coff == 0) {
+		free(sample.body.data);
+		return Z_BEST_COMPRESSION;
+	}
+
+	bound = compressBound(sample.body.coff);
+	zbuf = xmalloc(bound);
+	zlen1 = zlen9 = bound;
+	if (compress2(zbuf, &zlen1, (unsigned char *)sample.body.data,
+	    sample.body.coff, Z_BEST_SPEED) != Z_OK ||
+	    compress2(zbuf, &zlen9, (unsigned char *)sample.body.data,
+	    sample.body.coff, Z_BEST_COMPRESSION) != Z_OK)
+		zlen1 = zlen9 = bound;
+	free(zbuf);
+	free(sample.body.data);
+
+	/* Not worth inflating for less than 10% */
+	if (zlen9 * 10 > sample.body.coff * 9)
+		return 0;
+
+	/* Spend time on the best level only if it saves more than 2% */
+	if (zlen9 * 100 > zlen1 * 98)
+		return Z_BEST_SPEED;
+
+	return Z_BEST_COMPRESSION;
+}
+#endif /* ZLIB */
+
+struct idxent {
+	const char		*ie_name;
+	struct ctf_idxent	 ie_ent;
+};
+
+static int
+idxent_cmp(const void *a, const void *b)
+{
+	const struct idxent *ia = a, *ib = b;
+	int diff;
+
+	if ((diff = ia->ie_ent.ctie_kind - ib->ie_ent.ctie_kind) != 0)
+		return diff;
+	if ((diff = strcmp(ia->ie_name, ib->ie_name)) != 0)
+		return diff;
+	return ia->ie_ent.ctie_type - ib->ie_ent.ctie_type;
+}
+
+static int
+idxaddr_cmp(const void *a, const void *b)
+{
+	const struct ctf_idxaddr *ia = a, *ib = b;
+
+	if (ia->ctia_value != ib->ctia_value)
+		return ia->ctia_value < ib->ctia_value ? -1 : 1;
+	if (ia->ctia_index != ib->ctia_index)
+		return ia->ctia_index < ib->ctia_index ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Write the index of the named types, functions and objects of the
+ * section laid out in ``imcs'' to ``fd'', see ctfidx.h.
+ */
+int
+imcs_index(struct imcs *imcs, struct ctf_header *cth, int fd,
+    const char *path)
+{
+	struct ctf_idxhdr	 cti;
+	struct idxent		*ents;
+	struct itype		*it;
+	struct sink		 sink;
+	const char		*name;
+	size_t			 i, n = 0;
+
+	TAILQ_FOREACH(it, &itypeq, it_next)
+		n++;
+	ents = xreallocarray(NULL, MAXIMUM(n, 1), sizeof(*ents));
+
+	n = 0;
 	TAILQ_FOREACH(it, &itypeq, it_next) {
 		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
 			continue;
+		if ((name = it_name(it)) == NULL || *name == '\0')
+			continue;
 
-		imcs_add_type(imcs, it);
+		ents[n].ie_name = name;
+		ents[n].ie_ent.ctie_name = imcs_add_string(imcs, name);
+		ents[n].ie_ent.ctie_kind = it->it_type;
+		ents[n].ie_ent.ctie_type = it->it_idx;
+		n++;
 	}
+	qsort(ents, n, sizeof(*ents), idxent_cmp);
+
+	memset(&cti, 0, sizeof(cti));
+	cti.cti_magic = CTF_IDX_MAGIC;
+	cti.cti_version = CTF_IDX_VERSION;
+	cti.cti_count = n;
+	cti.cti_strlen = cth->cth_strlen;
+	cti.cti_nfuncs = nfuncaddrs;
+	cti.cti_nobjs = nobjaddrs;
+
+	sink_init(&sink, fd, path);
+	sink_write(&sink, &cti, sizeof(cti));
+	for (i = 0; i < n; i++)
+		sink_write(&sink, &ents[i].ie_ent, sizeof(ents[i].ie_ent));
+	free(ents);
+
+	/* Functions and objects are looked up by address. */
+	qsort(funcaddrs, nfuncaddrs, sizeof(*funcaddrs), idxaddr_cmp);
+	sink_write(&sink, funcaddrs, nfuncaddrs * sizeof(*funcaddrs));
+	qsort(objaddrs, nobjaddrs, sizeof(*objaddrs), idxaddr_cmp);
+	sink_write(&sink, objaddrs, nobjaddrs * sizeof(*objaddrs));
+
+	return sink_finish(&sink);
+}
 
-	/* String table is written from its own buffer. */
-	cth->cth_stroff = imcs->body.coff;
-	cth->cth_strlen = imcs->stab.coff;
+/*
+ * Write the section generated in ``imcs'', without compression, and
+ * the offset of each of its types to ``fd'', see ctfmap.h.
+ */
+int
+imcs_map(struct imcs *imcs, struct ctf_header *cth, int fd,
+    const char *path)
+{
+	struct ctf_maphdr	 ctm;
+	struct ctf_header	 ucth;
+	struct itype		*it;
+	struct sink		 sink;
+	uint32_t		*offs;
+	size_t			 i = 0, off;
+
+	assert(imcs->body.sink == NULL);
+	assert(imcs->body.coff == cth->cth_stroff);
+
+	memset(&ctm, 0, sizeof(ctm));
+	ctm.ctm_magic = CTF_MAP_MAGIC;
+	ctm.ctm_version = CTF_MAP_VERSION;
+	ctm.ctm_align = CTF_MAP_ALIGN;
+	ctm.ctm_ctfoff = ROUNDUP(sizeof(ctm), CTF_MAP_ALIGN);
+	ctm.ctm_ctflen = sizeof(ucth) + cth->cth_stroff + cth->cth_strlen;
+	ctm.ctm_typesoff = ROUNDUP(ctm.ctm_ctfoff + ctm.ctm_ctflen,
+	    CTF_MAP_ALIGN);
+	ctm.ctm_ntypes = tidx - tbase;
+	ctm.ctm_firsttype = tbase + 1;
+
+	/* Types are written in order and have a known size. */
+	offs = xreallocarray(NULL, MAXIMUM(ctm.ctm_ntypes, 1), sizeof(*offs));
+	off = sizeof(ucth) + cth->cth_typeoff;
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+			continue;
+
+		assert(it->it_idx == tbase + 1 + i);
+		offs[i++] = off;
+		off += imcs_type_size(it);
+	}
+	assert(i == ctm.ctm_ntypes);
+	assert(off == sizeof(ucth) + cth->cth_stroff);
+
+	ucth = *cth;
+	ucth.cth_flags &= ~CTF_F_COMPRESS;
+
+	sink_init(&sink, fd, path);
+	sink_write(&sink, &ctm, sizeof(ctm));
+	sink_zero(&sink, ctm.ctm_ctfoff - sizeof(ctm));
+	sink_write(&sink, &ucth, sizeof(ucth));
+	sink_write(&sink, imcs->body.data, imcs->body.coff);
+	sink_write(&sink, imcs->stab.data, imcs->stab.coff);
+	sink_zero(&sink, ctm.ctm_typesoff - ctm.ctm_ctfoff - ctm.ctm_ctflen);
+	sink_write(&sink, offs, ctm.ctm_ntypes * sizeof(*offs));
+	free(offs);
+
+	return sink_finish(&sink);
+}
+
+#ifdef ZLIB
+static void *
+zblock_compress(void *arg)
+{
+	struct zblock		*zb = arg;
+
+	zb->zb_outlen = compressBound(zb->zb_ent.ctbe_len);
+	zb->zb_out = xmalloc(zb->zb_outlen);
+	zb->zb_error = compress2((unsigned char *)zb->zb_out, &zb->zb_outlen,
+	    (const unsigned char *)zb->zb_in, zb->zb_ent.ctbe_len,
+	    zb->zb_level);
+
+	return NULL;
+}
+
+static struct zblock *
+zblock_add(struct zblock *zbs, size_t *nzbs, const char *in, size_t off,
+    size_t len)
+{
+	struct zblock		*zb;
+
+	zbs = xreallocarray(zbs, *nzbs + 1, sizeof(*zbs));
+	zb = &zbs[(*nzbs)++];
+	memset(zb, 0, sizeof(*zb));
+	zb->zb_in = in;
+	zb->zb_ent.ctbe_off = off;
+	zb->zb_ent.ctbe_len = len;
+
+	return zbs;
+}
+
+/*
+ * Write the section generated in ``imcs'' to ``fd'' compressed at
+ * ``level'' in independent blocks, with a table to seek to the block
+ * of any type, see ctfblk.h.  Up to ``njobs'' blocks are compressed
+ * in parallel.
+ */
+int
+imcs_blocks(struct imcs *imcs, struct ctf_header *cth, int level, int fd,
+    const char *path)
+{
+	struct ctf_blkhdr	 ctb;
+	struct ctf_header	 ucth;
+	struct zblock		*zbs = NULL, *zb;
+	struct itype		*it;
+	struct sink		 sink;
+	size_t			 i, j, n, nzbs = 0, off, zoff;
+	int			 error = 0;
+
+	assert(imcs->body.sink == NULL);
+	assert(imcs->body.coff == cth->cth_stroff);
+
+	/* Labels, objects and functions, then blocks of types. */
+	zbs = zblock_add(zbs, &nzbs, imcs->body.data, 0, cth->cth_typeoff);
+	zb = NULL;
+	off = cth->cth_typeoff;
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+			continue;
+
+		if (zb == NULL || zb->zb_ent.ctbe_len >= CTF_BLK_SIZE) {
+			zbs = zblock_add(zbs, &nzbs, imcs->body.data + off,
+			    off, 0);
+			zb = &zbs[nzbs - 1];
+			zb->zb_ent.ctbe_type = it->it_idx;
+		}
+		zb->zb_ent.ctbe_len += imcs_type_size(it);
+		zb->zb_ent.ctbe_ntypes++;
+		off += imcs_type_size(it);
+	}
+	assert(off == cth->cth_stroff);
+	zbs = zblock_add(zbs, &nzbs, imcs->stab.data, cth->cth_stroff,
+	    cth->cth_strlen);
+
+	/* Blocks are independent, compress them in batches. */
+	for (i = 0; i < nzbs; i += n) {
+		n = MINIMUM(nzbs - i, (size_t)MAXIMUM(njobs, 1));
+		for (j = 1; j < n; j++) {
+			zb = &zbs[i + j];
+			zb->zb_level = level;
+			zb->zb_threaded = (pthread_create(&zb->zb_thread, NULL,
+			    zblock_compress, zb) == 0);
+			if (!zb->zb_threaded)
+				zblock_compress(zb);
+		}
+		zbs[i].zb_level = level;
+		zblock_compress(&zbs[i]);
+		for (j = 0; j < n; j++) {
+			zb = &zbs[i + j];
+			if (zb->zb_threaded)
+				pthread_join(zb->zb_thread, NULL);
+		}
+	}
+
+	zoff = sizeof(ctb) + sizeof(ucth) + nzbs * sizeof(zb->zb_ent);
+	for (i = 0; i < nzbs; i++) {
+		zb = &zbs[i];
+		if (zb->zb_error != Z_OK && error == 0) {
+			warnx("zlib compress failed: %s", zError(zb->zb_error));
+			error = -1;
+		}
+		zb->zb_ent.ctbe_zoff = zoff;
+		zb->zb_ent.ctbe_zlen = zb->zb_outlen;
+		zoff += zb->zb_outlen;
+	}
+
+	if (error == 0) {
+		memset(&ctb, 0, sizeof(ctb));
+		ctb.ctb_magic = CTF_BLK_MAGIC;
+		ctb.ctb_version = CTF_BLK_VERSION;
+		ctb.ctb_blksize = CTF_BLK_SIZE;
+		ctb.ctb_nblocks = nzbs;
+
+		ucth = *cth;
+		ucth.cth_flags &= ~CTF_F_COMPRESS;
+
+		sink_init(&sink, fd, path);
+		sink_write(&sink, &ctb, sizeof(ctb));
+		sink_write(&sink, &ucth, sizeof(ucth));
+		for (i = 0; i < nzbs; i++)
+			sink_write(&sink, &zbs[i].zb_ent,
+			    sizeof(zbs[i].zb_ent));
+		for (i = 0; i < nzbs; i++)
+			sink_write(&sink, zbs[i].zb_out, zbs[i].zb_outlen);
+		error = sink_finish(&sink);
+	}
+
+	for (i = 0; i < nzbs; i++)
+		free(zbs[i].zb_out);
+	free(zbs);
+
+	return error;
 }
+#endif /* ZLIB */
 
 /*
- * Generate a CTF buffer from the internal type representation.
+ * Generate a CTF section from the internal type representation and
+ * stream it to ``fd''.  The data is deflated at ``zlevel'', or at a
+ * level derived from its content if ``zlevel'' is negative.  Level 0
+ * disables compression.  If ``xfd'' is not -1 an index of the named
+ * types is written to it.  If ``mfd'' or ``bfd'' is not -1 the section
+ * is kept in memory to also be written there, either uncompressed with
+ * the offsets of its types or compressed in blocks.
  */
 int
-generate(int fd, const char *path, const char *label, int compress)
+generate(int fd, const char *path, int xfd, const char *xpath, int mfd,
+    const char *mpath, int bfd, const char *bpath, const char *label,
+    int zlevel)
 {
-	char			*p, *ctfdata = NULL;
-	ssize_t			 ctflen;
 	struct ctf_header	 cth;
 	struct imcs		 imcs;
-	int			 error = 0;
+	struct sink		 sink;
 
 	memset(&cth, 0, sizeof(cth));
 
 	cth.cth_magic = CTF_MAGIC;
 	cth.cth_version = CTF_VERSION;
 
+	/* The header is complete before the body is generated. */
+	imcs_init(&imcs, &cth, label);
+
 #ifdef ZLIB
-	if (compress)
+	if (zlevel < 0)
+		zlevel = zlevel_auto(&imcs, &cth);
+	if (zlevel > 0)
 		cth.cth_flags = CTF_F_COMPRESS;
 #endif /* ZLIB */
 
-	imcs_generate(&imcs, &cth, label);
+	sink_init(&sink, fd, path);
+	sink_write(&sink, &cth, sizeof(cth));
 
-	ctflen = sizeof(cth) + imcs.body.coff + imcs.stab.coff;
-	p = ctfdata = xmalloc(ctflen);
+#ifdef ZLIB
+	if (zlevel > 0 && sink_deflate_init(&sink, zlevel, njobs) != 0) {
+		sink_finish(&sink);
+		return -1;
+	}
+#endif /* ZLIB */
+
+	if (mfd != -1 || bfd != -1) {
+		imcs_generate(&imcs, &cth, label, NULL);
+		sink_write(&sink, imcs.body.data, imcs.body.coff);
+		sink_write(&sink, imcs.stab.data, imcs.stab.coff);
+	} else
+		imcs_generate(&imcs, &cth, label, &sink);
+
+	if (sink_finish(&sink) != 0)
+		return -1;
+
+	if (mfd != -1 && imcs_map(&imcs, &cth, mfd, mpath) != 0)
+		return -1;
+
+#ifdef ZLIB
+	if (bfd != -1 && imcs_blocks(&imcs, &cth, zlevel, bfd, bpath) != 0)
+		return -1;
+#endif /* ZLIB */
+
+	if (xfd != -1)
+		return imcs_index(&imcs, &cth, xfd, xpath);
+
+	return 0;
+}
 
-	memcpy(p, &cth, sizeof(cth));
-	p += sizeof(cth);
+void
+sink_init(struct sink *sk, int fd, const char *path)
+{
+	memset(sk, 0, sizeof(*sk));
+	sk->sk_fd = fd;
+	sk->sk_path = path;
+	sk->sk_buf = xmalloc(SINK_BUFSZ);
+}
+
+/*
+ * Write the pending output of ``sk'' to its file descriptor.
+ */
+static void
+sink_flush(struct sink *sk)
+{
+	ssize_t		 n;
+	size_t		 off = 0;
+
+	while (sk->sk_error == 0 && off < sk->sk_len) {
+		n = write(sk->sk_fd, sk->sk_buf + off, sk->sk_len - off);
+		if (n == -1) {
+			warn("unable to write %zu bytes for %s",
+			    sk->sk_len - off, sk->sk_path);
+			sk->sk_error = -1;
+			break;
+		}
+		off += n;
+	}
+
+	sk->sk_len = 0;
+}
 
-	memcpy(p, imcs.body.data, imcs.body.coff);
-	p += imcs.body.coff;
+/*
+ * Append ``data'' to the pending output of ``sk'' as is.
+ */
+static void
+sink_put(struct sink *sk, const void *data, size_t len)
+{
+	size_t		 n;
 
-	memcpy(p, imcs.stab.data, imcs.stab.coff);
-	p += imcs.stab.coff;
+	while (len > 0) {
+		n = MINIMUM(len, SINK_BUFSZ - sk->sk_len);
+		memcpy(sk->sk_buf + sk->sk_len, data, n);
+		sk->sk_len += n;
+		data = (const char *)data + n;
+		len -= n;
 
-	assert((p - ctfdata) == ctflen);
+		if (sk->sk_len == SINK_BUFSZ)
+			sink_flush(sk);
+	}
+}
 
 #ifdef ZLIB
-	if (compress) {
-		char *cdata;
-		size_t clen;
-
-		cdata = data_compress(ctfdata + sizeof(cth),
-		    ctflen - sizeof(cth), ctflen - sizeof(cth), &clen);
-		if (cdata == NULL) {
-			warnx("compressing CTF data");
-			free(ctfdata);
+/*
+ * Deflate everything written to ``sk'' from now on.  With more than one
+ * job the data is split in blocks compressed in parallel.
+ */
+int
+sink_deflate_init(struct sink *sk, int level, int jobs)
+{
+	uint16_t	 hdr;
+	unsigned char	 zhdr[2];
+	int		 error, flevel, i;
+
+	if (jobs <= 1) {
+		error = deflateInit(&sk->sk_zs, level);
+		if (error != Z_OK) {
+			warnx("zlib deflateInit failed: %s", zError(error));
 			return -1;
 		}
+		sk->sk_compress = 1;
+		return 0;
+	}
 
-		memcpy(ctfdata + sizeof(cth), cdata, clen);
-		ctflen = clen + sizeof(cth);
+	sk->sk_njobs = jobs;
+	sk->sk_level = level;
+	sk->sk_blocks = xcalloc(jobs, sizeof(*sk->sk_blocks));
+	for (i = 0; i < jobs; i++)
+		sk->sk_blocks[i].pb_in = xmalloc(PZ_BLOCKSZ);
+	sk->sk_dict = xmalloc(PZ_DICTSZ);
+	sk->sk_check = adler32(0L, Z_NULL, 0);
+
+	/* Same zlib header deflate(3) would generate for ``level''. */
+	if (level >= 0 && level < 2)
+		flevel = 0;
+	else if (level >= 0 && level < 6)
+		flevel = 1;
+	else if (level == 6 || level == Z_DEFAULT_COMPRESSION)
+		flevel = 2;
+	else
+		flevel = 3;
+	hdr = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8 | (flevel << 6);
+	hdr += 31 - (hdr % 31);
+	zhdr[0] = hdr >> 8;
+	zhdr[1] = hdr & 0xff;
+	sink_put(sk, zhdr, sizeof(zhdr));
+
+	sk->sk_compress = 1;
+	return 0;
+}
 
-		free(cdata);
+static void *
+pzblock_deflate(void *arg)
+{
+	struct pzblock	*pb = arg;
+	z_stream	 zs;
+	size_t		 bound;
+	int		 error;
+
+	memset(&zs, 0, sizeof(zs));
+	error = deflateInit2(&zs, pb->pb_level, Z_DEFLATED, -MAX_WBITS, 8,
+	    Z_DEFAULT_STRATEGY);
+	if (error != Z_OK) {
+		pb->pb_error = error;
+		return NULL;
 	}
-#endif /* ZLIB */
 
-	if (write(fd, ctfdata, ctflen) != ctflen) {
-		warn("unable to write %zd bytes for %s", ctflen, path);
-		error = -1;
+	if (pb->pb_dictlen > 0) {
+		error = deflateSetDictionary(&zs,
+		    (const unsigned char *)pb->pb_dict, pb->pb_dictlen);
+		if (error != Z_OK)
+			goto out;
 	}
 
-	free(ctfdata);
-	return error;
+	/* Leave room for the empty stored block of the sync flush. */
+	bound = deflateBound(&zs, pb->pb_inlen) + 16;
+	pb->pb_out = xrealloc(pb->pb_out, bound);
+
+	zs.next_in = (unsigned char *)pb->pb_in;
+	zs.avail_in = pb->pb_inlen;
+	zs.next_out = (unsigned char *)pb->pb_out;
+	zs.avail_out = bound;
+
+	error = deflate(&zs, pb->pb_last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (error == (pb->pb_last ? Z_STREAM_END : Z_OK) && zs.avail_in == 0)
+		error = Z_OK;
+	else if (error == Z_OK || error == Z_STREAM_END)
+		error = Z_BUF_ERROR;
+
+	pb->pb_outlen = bound - zs.avail_out;
+	pb->pb_check = adler32(adler32(0L, Z_NULL, 0),
+	    (const unsigned char *)pb->pb_in, pb->pb_inlen);
+out:
+	deflateEnd(&zs);
+	pb->pb_error = error;
+	return NULL;
 }
 
-#ifdef ZLIB
-char *
-data_compress(const char *buf, size_t size, off_t len, size_t *pclen)
+/*
+ * Deflate the ``n'' first blocks of the current batch in parallel and
+ * write their output in order.
+ */
+static void
+sink_pzbatch(struct sink *sk, int n, int last)
 {
-	z_stream		 stream;
-	char			*data;
-	int			 error;
+	struct pzblock	*pb;
+	const char	*dict = sk->sk_dict;
+	size_t		 dictlen = sk->sk_dictlen;
+	unsigned char	 check[4];
+	int		 i;
+
+	for (i = 0; i < n; i++) {
+		pb = &sk->sk_blocks[i];
+		pb->pb_dict = dict;
+		pb->pb_dictlen = dictlen;
+		pb->pb_level = sk->sk_level;
+		pb->pb_last = last && (i == n - 1);
+
+		dictlen = MINIMUM(pb->pb_inlen, PZ_DICTSZ);
+		dict = pb->pb_in + pb->pb_inlen - dictlen;
+	}
 
-	data = malloc(len);
-	if (data == NULL) {
-		warn(NULL);
-		return NULL;
+	/* The first block is deflated by the calling thread. */
+	for (i = 1; i < n; i++) {
+		pb = &sk->sk_blocks[i];
+		pb->pb_threaded = (pthread_create(&pb->pb_thread, NULL,
+		    pzblock_deflate, pb) == 0);
+		if (!pb->pb_threaded)
+			pzblock_deflate(pb);
 	}
+	pzblock_deflate(&sk->sk_blocks[0]);
 
-	memset(&stream, 0, sizeof(stream));
-	stream.zalloc = Z_NULL;
-	stream.zfree = Z_NULL;
-	stream.opaque = Z_NULL;
+	for (i = 1; i < n; i++) {
+		pb = &sk->sk_blocks[i];
+		if (pb->pb_threaded)
+			pthread_join(pb->pb_thread, NULL);
+	}
 
-	if ((error = deflateInit(&stream, Z_BEST_COMPRESSION)) != Z_OK) {
-		warnx("zlib deflateInit failed: %s", zError(error));
-		goto exit;
+	for (i = 0; i < n; i++) {
+		pb = &sk->sk_blocks[i];
+		if (pb->pb_error != Z_OK) {
+			warnx("zlib deflate failed: %s", zError(pb->pb_error));
+			sk->sk_error = -1;
+			continue;
+		}
+		sink_put(sk, pb->pb_out, pb->pb_outlen);
+		sk->sk_check = adler32_combine(sk->sk_check, pb->pb_check,
+		    pb->pb_inlen);
 	}
 
-	stream.next_in = (void *)buf;
-	stream.avail_in = size;
-	stream.next_out = (unsigned char *)data;
-	stream.avail_out = len;
+	/* The last block primes the first one of the next batch. */
+	memcpy(sk->sk_dict, dict, dictlen);
+	sk->sk_dictlen = dictlen;
+
+	for (i = 0; i < n; i++)
+		sk->sk_blocks[i].pb_inlen = 0;
+	sk->sk_nblocks = 0;
 
-	if ((error = deflate(&stream, Z_FINISH)) != Z_STREAM_END) {
-		warnx("zlib deflate failed: %s", zError(error));
-		deflateEnd(&stream);
-		goto exit;
+	if (last) {
+		check[0] = sk->sk_check >> 24;
+		check[1] = sk->sk_check >> 16;
+		check[2] = sk->sk_check >> 8;
+		check[3] = sk->sk_check;
+		sink_put(sk, check, sizeof(check));
 	}
+}
 
-	if ((error = deflateEnd(&stream)) != Z_OK) {
-		warnx("zlib deflateEnd failed: %s", zError(error));
-		goto exit;
+static void
+sink_pzwrite(struct sink *sk, const void *data, size_t len)
+{
+	struct pzblock	*pb;
+	size_t		 n;
+
+	while (len > 0) {
+		pb = &sk->sk_blocks[sk->sk_nblocks];
+		n = MINIMUM(len, PZ_BLOCKSZ - pb->pb_inlen);
+		memcpy(pb->pb_in + pb->pb_inlen, data, n);
+		pb->pb_inlen += n;
+		data = (const char *)data + n;
+		len -= n;
+
+		if (pb->pb_inlen == PZ_BLOCKSZ &&
+		    ++sk->sk_nblocks == sk->sk_njobs)
+			sink_pzbatch(sk, sk->sk_nblocks, 0);
 	}
+}
 
-	if (pclen != NULL)
-		*pclen = stream.total_out;
+static void
+sink_deflate(struct sink *sk, const void *data, size_t len, int flush)
+{
+	z_stream	*zs = &sk->sk_zs;
+	int		 error;
+
+	zs->next_in = (void *)data;
+	zs->avail_in = len;
+
+	do {
+		zs->next_out = (unsigned char *)sk->sk_buf + sk->sk_len;
+		zs->avail_out = SINK_BUFSZ - sk->sk_len;
+
+		error = deflate(zs, flush);
+		if (error != Z_OK && error != Z_BUF_ERROR &&
+		    error != Z_STREAM_END) {
+			warnx("zlib deflate failed: %s", zError(error));
+			sk->sk_error = -1;
+			return;
+		}
 
-	return data;
+		sk->sk_len = SINK_BUFSZ - zs->avail_out;
+		if (zs->avail_out == 0)
+			sink_flush(sk);
+	} while (zs->avail_in > 0 || (flush == Z_FINISH &&
+	    error != Z_STREAM_END));
+}
+#endif /* ZLIB */
 
-exit:
-	free(data);
-	return NULL;
+void
+sink_write(struct sink *sk, const void *data, size_t len)
+{
+	if (sk->sk_error != 0)
+		return;
+
+#ifdef ZLIB
+	if (sk->sk_compress && sk->sk_njobs > 1) {
+		sink_pzwrite(sk, data, len);
+		return;
+	}
+	if (sk->sk_compress) {
+		sink_deflate(sk, data, len, Z_NO_FLUSH);
+		return;
+	}
+#endif /* ZLIB */
+
+	sink_put(sk, data, len);
 }
+
+/*
+ * Write ``len'' zero bytes to ``sk''.
+ */
+void
+sink_zero(struct sink *sk, size_t len)
+{
+	static const char	 zero[512];
+	size_t			 n;
+
+	while (len > 0) {
+		n = MINIMUM(len, sizeof(zero));
+		sink_write(sk, zero, n);
+		len -= n;
+	}
+}
+
+/*
+ * Terminate the deflate stream if any, write the remaining output and
+ * release ``sk''.
+ */
+int
+sink_finish(struct sink *sk)
+{
+	int		 error;
+
+#ifdef ZLIB
+	if (sk->sk_compress && sk->sk_njobs > 1) {
+		int	 i;
+
+		/* Flush the partial block, possibly empty, last. */
+		if (sk->sk_error == 0)
+			sink_pzbatch(sk, sk->sk_nblocks + 1, 1);
+		for (i = 0; i < sk->sk_njobs; i++) {
+			free(sk->sk_blocks[i].pb_in);
+			free(sk->sk_blocks[i].pb_out);
+		}
+		free(sk->sk_blocks);
+		free(sk->sk_dict);
+	} else if (sk->sk_compress) {
+		if (sk->sk_error == 0)
+			sink_deflate(sk, NULL, 0, Z_FINISH);
+		if ((error = deflateEnd(&sk->sk_zs)) != Z_OK &&
+		    sk->sk_error == 0) {
+			warnx("zlib deflateEnd failed: %s", zError(error));
+			sk->sk_error = -1;
+		}
+	}
 #endif /* ZLIB */
+
+	sink_flush(sk);
+	error = sk->sk_error;
+
+	free(sk->sk_buf);
+	sk->sk_buf = NULL;
+
+	return error;
+}
@@ -0,0 +1,372 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Open addressing hash table with one control byte per slot.
+ *
+ * A control byte is either CTRL_EMPTY or holds the low 7 bits of the
+ * hash of the entry stored in the slot.  Lookups compare a group of
+ * GROUPSZ control bytes at once and only look at the entries whose
+ * control byte matches.  Entries are never removed, so there are no
+ * tombstones and a lookup stops at the first group with an empty slot.
+ *
+ * The first GROUPSZ control bytes are mirrored after the last one so
+ * that a group can be loaded from any position without wrapping.
+ */
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+#include "xmalloc.h"
+#include "htab.h"
+
+#define GROUPSZ		16
+#define MINSIZE		GROUPSZ
+
+#define CTRL_EMPTY	0x80
+
+#define H1(hv)		((hv) >> 7)
+#define H2(hv)		((uint8_t)((hv) & 0x7f))
+
+/* Seed used for the keys of all tables. */
+#define HTAB_SEED	0
+
+struct htab {
+	uint8_t			 *h_ctrl;	/* size + GROUPSZ control bytes */
+	struct htab_entry	**h_slots;
+	unsigned int		  h_mask;	/* size - 1 */
+	unsigned int		  h_count;	/* # of entries */
+	unsigned int		  h_growth;	/* # of entries before resize */
+};
+
+static void	 htab_alloc(struct htab *, unsigned int);
+static void	 htab_resize(struct htab *);
+
+#ifndef __SSE2__
+#define LSB	0x0101010101010101ULL
+#define LOW7	0x7f7f7f7f7f7f7f7fULL
+
+/*
+ * Return a bitmask of the bytes of ``w'' equal to ``c''.
+ */
+static inline uint32_t
+swar_match(uint64_t w, uint8_t c)
+{
+	uint64_t t;
+
+	w ^= c * LSB;
+	/* Set the high bit of bytes that are zero, without borrows. */
+	t = ~(((w & LOW7) + LOW7) | w | LOW7);
+#if BYTE_ORDER == BIG_ENDIAN
+	t = __builtin_bswap64(t);
+#endif
+	/* Gather the high bits in the top byte. */
+	return ((t >> 7) * 0x0102040810204080ULL) >> 56;
+}
+#endif /* !__SSE2__ */
+
+/*
+ * Return a bitmask of the control bytes of the group starting at ``g''
+ * that are equal to ``c''.
+ */
+static inline uint32_t
+group_match(const uint8_t *g, uint8_t c)
+{
+#ifdef __SSE2__
+	__m128i grp = _mm_loadu_si128((const __m128i *)g);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(grp, _mm_set1_epi8(c)));
+#else
+	uint64_t w;
+	uint32_t m;
+
+	memcpy(&w, g, sizeof(w));
+	m = swar_match(w, c);
+	memcpy(&w, g + 8, sizeof(w));
+
+	return m | (swar_match(w, c) << 8);
+#endif /* __SSE2__ */
+}
+
+#define group_empty(g)	group_match((g), CTRL_EMPTY)
+
+static inline void
+htab_set_ctrl(struct htab *h, unsigned int i, uint8_t c)
+{
+	h->h_ctrl[i] = c;
+	if (i < GROUPSZ)
+		h->h_ctrl[h->h_mask + 1 + i] = c;
+}
+
+/*
+ * Return the first empty slot of the probe sequence of ``hv''.
+ */
+static unsigned int
+htab_probe_empty(struct htab *h, uint64_t hv)
+{
+	unsigned int pos, step = 0;
+	uint32_t m;
+
+	pos = H1(hv) & h->h_mask;
+	for (;;) {
+		m = group_empty(h->h_ctrl + pos);
+		if (m != 0)
+			return (pos + __builtin_ctz(m)) & h->h_mask;
+		step += GROUPSZ;
+		pos = (pos + step) & h->h_mask;
+	}
+}
+
+static void
+htab_alloc(struct htab *h, unsigned int size)
+{
+	h->h_ctrl = xmalloc(size + GROUPSZ);
+	memset(h->h_ctrl, CTRL_EMPTY, size + GROUPSZ);
+	h->h_slots = xcalloc(size, sizeof(*h->h_slots));
+	h->h_mask = size - 1;
+	/* Keep at least 1/8 of the slots empty. */
+	h->h_growth = size - size / 8 - h->h_count;
+}
+
+/*
+ * Double the size of the table.  Hashes are stored in the entries so
+ * keys don't need to be read again.
+ */
+static void
+htab_resize(struct htab *h)
+{
+	struct htab_entry **oslots = h->h_slots, *he;
+	uint8_t *octrl = h->h_ctrl;
+	unsigned int i, j, osize = h->h_mask + 1;
+
+	htab_alloc(h, osize * 2);
+	for (i = 0; i < osize; i++) {
+		if (octrl[i] == CTRL_EMPTY)
+			continue;
+		he = oslots[i];
+		j = htab_probe_empty(h, he->hval);
+		htab_set_ctrl(h, j, H2(he->hval));
+		h->h_slots[j] = he;
+	}
+	free(octrl);
+	free(oslots);
+}
+
+/*
+ * Create a table able to hold ``1 << size'' entries without resizing.
+ */
+struct htab *
+htab_init(unsigned int size)
+{
+	struct htab *h;
+	unsigned int n;
+
+	h = xcalloc(1, sizeof(*h));
+	n = 1U << size;
+	n += n / 7;		/* load factor */
+	size = MINSIZE;
+	while (size < n)
+		size <<= 1;
+	htab_alloc(h, size);
+
+	return h;
+}
+
+/*
+ * Only free the table, use htab_first/htab_next to free entries.
+ */
+void
+htab_free(struct htab *h)
+{
+	free(h->h_ctrl);
+	free(h->h_slots);
+	free(h);
+}
+
+/*
+ * Look for the entry whose key is the ``len'' bytes at ``key''.  If it
+ * is not found NULL is returned and ``slot'', if not NULL, is set to a
+ * position suitable for htab_insert().
+ */
+struct htab_entry *
+htab_find(struct htab *h, const void *key, size_t len, unsigned int *slot)
+{
+	struct htab_entry *he;
+	unsigned int pos, i, step = 0;
+	uint64_t hv;
+	uint32_t m;
+	uint8_t c;
+
+	hv = htab_hash(key, len, HTAB_SEED);
+	c = H2(hv);
+	pos = H1(hv) & h->h_mask;
+	for (;;) {
+		m = group_match(h->h_ctrl + pos, c);
+		while (m != 0) {
+			i = (pos + __builtin_ctz(m)) & h->h_mask;
+			he = h->h_slots[i];
+			if (he->hval == hv && he->hlen == len &&
+			    memcmp(he->hkey, key, len) == 0)
+				return he;
+			m &= m - 1;
+		}
+		m = group_empty(h->h_ctrl + pos);
+		if (m != 0) {
+			if (slot != NULL)
+				*slot = (pos + __builtin_ctz(m)) & h->h_mask;
+			return NULL;
+		}
+		step += GROUPSZ;
+		pos = (pos + step) & h->h_mask;
+	}
+}
+
+/*
+ * Insert ``he'' at the position returned by a failed htab_find() for
+ * the same key.  The key must stay valid as long as ``he'' is in the
+ * table.
+ */
+void
+htab_insert(struct htab *h, unsigned int slot, struct htab_entry *he,
+    const void *key, size_t len)
+{
+	assert(h->h_ctrl[slot] == CTRL_EMPTY);
+
+	he->hkey = key;
+	he->hlen = len;
+	he->hval = htab_hash(key, len, HTAB_SEED);
+
+	htab_set_ctrl(h, slot, H2(he->hval));
+	h->h_slots[slot] = he;
+	h->h_count++;
+	if (--h->h_growth == 0)
+		htab_resize(h);
+}
+
+unsigned int
+htab_count(struct htab *h)
+{
+	return h->h_count;
+}
+
+void *
+htab_first(struct htab *h, unsigned int *pos)
+{
+	*pos = 0;
+	return htab_next(h, pos);
+}
+
+void *
+htab_next(struct htab *h, unsigned int *pos)
+{
+	for (; *pos <= h->h_mask; (*pos)++)
+		if (h->h_ctrl[*pos] != CTRL_EMPTY)
+			return h->h_slots[(*pos)++];
+	return NULL;
+}
+
+/*
+ * 64-bit hash of ``len'' bytes at ``key'', derived from xxHash64.
+ * Different seeds give independent hashes of the same key.
+ */
+#define P1	0x9e3779b185ebca87ULL
+#define P2	0xc2b2ae3d27d4eb4fULL
+#define P3	0x165667b19e3779f9ULL
+#define P4	0x85ebca77c2b2ae63ULL
+#define P5	0x27d4eb2f165667c5ULL
+
+#define ROTL(x, r)	(((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t
+xxh_round(uint64_t acc, uint64_t v)
+{
+	acc += v * P2;
+	acc = ROTL(acc, 31);
+	return acc * P1;
+}
+
+static inline uint64_t
+xxh_merge(uint64_t h, uint64_t acc)
+{
+	h ^= xxh_round(0, acc);
+	return h * P1 + P4;
+}
+
+uint64_t
+htab_hash(const void *key, size_t len, uint64_t seed)
+{
+	const uint8_t *p = key, *end = p + len;
+	uint64_t h, v1, v2, v3, v4, k;
+	uint32_t k32;
+
+	if (len >= 32) {
+		v1 = seed + P1 + P2;
+		v2 = seed + P2;
+		v3 = seed;
+		v4 = seed - P1;
+		do {
+			memcpy(&k, p, 8);
+			v1 = xxh_round(v1, k);
+			memcpy(&k, p + 8, 8);
+			v2 = xxh_round(v2, k);
+			memcpy(&k, p + 16, 8);
+			v3 = xxh_round(v3, k);
+			memcpy(&k, p + 24, 8);
+			v4 = xxh_round(v4, k);
+			p += 32;
+		} while (p + 32 <= end);
+		h = ROTL(v1, 1) + ROTL(v2, 7) + ROTL(v3, 12) + ROTL(v4, 18);
+		h = xxh_merge(h, v1);
+		h = xxh_merge(h, v2);
+		h = xxh_merge(h, v3);
+		h = xxh_merge(h, v4);
+	} else
+		h = seed + P5;
+
+	h += len;
+	for (; p + 8 <= end; p += 8) {
+		memcpy(&k, p, 8);
+		h ^= xxh_round(0, k);
+		h = ROTL(h, 27) * P1 + P4;
+	}
+	if (p + 4 <= end) {
+		memcpy(&k32, p, 4);
+		h ^= (uint64_t)k32 * P1;
+		h = ROTL(h, 23) * P2 + P3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * P5;
+		h = ROTL(h, 11) * P1;
+	}
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+
+	return h;
+}
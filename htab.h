@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _HTAB_H_
+#define _HTAB_H_
+
+struct htab;
+
+struct htab_entry {
+	const char	*hkey;
+	size_t		 hlen;		/* length of the key */
+	uint64_t	 hval;		/* hash of the key */
+};
+
+struct htab	*htab_init(unsigned int);
+void		 htab_free(struct htab *);
+
+struct htab_entry *htab_find(struct htab *, const void *, size_t,
+		    unsigned int *);
+void		 htab_insert(struct htab *, unsigned int, struct htab_entry *,
+		    const void *, size_t);
+unsigned int	 htab_count(struct htab *);
+
+void		*htab_first(struct htab *, unsigned int *);
+void		*htab_next(struct htab *, unsigned int *);
+
+uint64_t	 htab_hash(const void *, size_t, uint64_t);
+
+#endif /* _HTAB_H_ */
@@ -62,6 +62,8 @@ struct itype {
 #define	ITF_INSERTED		 0x20	    /* already found/inserted */
 #define	ITF_USED		 0x40	    /* referenced in the current CU */
 #define	ITF_ANON		 0x80	    /* type without name */
+#define	ITF_PARENT		 0x100	    /* type of the parent CTF */
+#define	ITF_GLOBAL		 0x200	    /* symbol with global binding */
 #define	ITF_MASK		(ITF_INSERTED|ITF_USED)
 
 	uint64_t		 it_gen;    /* graph visitation generation */
@@ -96,8 +98,14 @@ RB_HEAD(isymb_tree, itype);
 extern struct itype_queue itypeq, ifuncq, iobjq;
 extern struct isymb_tree isymbt;	    /* tree of symbols */
 extern uint16_t tidx;		    	    /* type index */
+extern uint16_t tbase;		    	    /* last ID of the parent */
 extern uint16_t long_tidx;		    /* type ID for "long" */
 
+/* orders of types in the emitted section */
+#define TYPE_ORDER_NONE		0	    /* order of discovery */
+#define TYPE_ORDER_DFS		1	    /* depth-first from symbols */
+#define TYPE_ORDER_BFS		2	    /* breadth-first from symbols */
+
 RB_PROTOTYPE(isymb_tree, itype, it_node, it_name_cmp);
 
 struct itype *it_dup(struct itype *);
@@ -29,6 +29,7 @@
 #include <assert.h>
 #include <limits.h>
 #include <err.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -44,6 +45,10 @@
 
 #ifndef NOPOOL
 struct pool it_pool, im_pool, ir_pool;
+extern struct pool dcu_pool, die_pool, dav_pool, dab_pool, dat_pool;
+
+/* Bytes of .debug_info per type, member or reference, roughly */
+#define IT_PER_INFO	32
 #endif /* NOPOOL */
 
 #define DPRINTF(x...)	do { /*printf(x)*/ } while (0)
@@ -74,6 +79,7 @@ struct isymb_tree	 isymbt;
 struct itype		*void_it;
 uint16_t		 tidx, fidx, oidx;	/* type, func & object IDs */
 uint16_t		 long_tidx;		/* index of "long", for array */
+uint16_t		 tbase;			/* last ID of the parent */
 
 
 void		 cu_stat(void);
@@ -83,6 +89,8 @@ void		 cu_resolve(struct dwcu *, struct itype_queue *,
 		     struct ioff_tree *);
 void		 cu_reference(struct dwcu *, struct itype_queue *);
 void		 cu_merge(struct dwcu *, struct itype_queue *);
+void		 types_reorder(int);
+void		 it_parent_insert(struct itype *);
 
 struct itype	*parse_base(struct dwdie *, size_t);
 struct itype	*parse_refers(struct dwdie *, size_t, int);
@@ -107,13 +115,18 @@ struct itype	*it_new(uint64_t, size_t, const char *, uint32_t, uint16_t,
 void		 it_reference(struct itype *);
 void		 it_free(struct itype *);
 int		 it_cmp(struct itype *, struct itype *);
+int		 it_tree_cmp(struct itype *, struct itype *);
 int		 it_name_cmp(struct itype *, struct itype *);
 int		 it_off_cmp(struct itype *, struct itype *);
 void		 ir_add(struct itype *, struct itype *);
 void		 ir_purge(struct itype *);
 struct imember	*im_new(const char *, size_t, size_t);
+static uint16_t	 it_nextidx(void);
+
+/* ctf.c */
+void		 ctf_parent_insert(size_t);
 
-RB_GENERATE(itype_tree, itype, it_node, it_cmp);
+RB_GENERATE(itype_tree, itype, it_node, it_tree_cmp);
 RB_GENERATE(isymb_tree, itype, it_node, it_name_cmp);
 RB_GENERATE(ioff_tree, itype, it_node, it_off_cmp);
 
@@ -133,20 +146,30 @@ dwarf_parse(const char *infobuf, size_t infolen, const char *abbuf,
 	struct ioff_tree	 cu_iofft;
 	struct itype_queue	 cu_itypeq;
 	struct itype		*it;
-	int			 i;
 
-	for (i = 0; i < CTF_K_MAX; i++)
-		RB_INIT(&itypet[i]);
 	RB_INIT(&isymbt);
 
-	void_it = it_new(++tidx, VOID_OFFSET, "void", 0,
-	    CTF_INT_SIGNED, 0, CTF_K_INTEGER, 0);
-	TAILQ_INSERT_TAIL(&itypeq, void_it, it_next);
+	/* The parent, if any, might already provide "void". */
+	if (void_it == NULL) {
+		void_it = it_new(it_nextidx(), VOID_OFFSET, "void", 0,
+		    CTF_INT_SIGNED, 0, CTF_K_INTEGER, 0);
+		TAILQ_INSERT_TAIL(&itypeq, void_it, it_next);
+	}
+
+#ifndef NOPOOL
+	/* Slabs are touched lazily, estimates only cost address space. */
+	pool_sizehint(&it_pool, infolen / IT_PER_INFO);
+	pool_sizehint(&im_pool, infolen / IT_PER_INFO);
+	pool_sizehint(&ir_pool, infolen / IT_PER_INFO);
+#endif /* NOPOOL */
 
 	while (dw_cu_parse(&info, &abbrev, infolen, &dcu) == 0) {
 		TAILQ_INIT(&cu_itypeq);
 		RB_INIT(&cu_iofft);
 
+		/* The parent's pointers are as large as the addresses. */
+		ctf_parent_insert(dcu->dcu_psize);
+
 		/* Parse this CU */
 		cu_parse(dcu, &cu_itypeq, &cu_iofft);
 
@@ -168,6 +191,15 @@ dwarf_parse(const char *infobuf, size_t infolen, const char *abbuf,
 		dw_dcu_free(dcu);
 	}
 
+#ifndef NOPOOL
+	/* DIEs are only needed while parsing their CU. */
+	pool_release(&dcu_pool);
+	pool_release(&die_pool);
+	pool_release(&dav_pool);
+	pool_release(&dab_pool);
+	pool_release(&dat_pool);
+#endif /* NOPOOL */
+
 	/* We force array's index type to be 'long', for that we need its ID. */
 	RB_FOREACH(it, itype_tree, &itypet[CTF_K_INTEGER]) {
 		if (it_name(it) == NULL || it->it_size != (8 * sizeof(long)))
@@ -180,6 +212,18 @@ dwarf_parse(const char *infobuf, size_t infolen, const char *abbuf,
 	}
 }
 
+/*
+ * ID of a new type, CTF refers to types with 16bit IDs.
+ */
+static uint16_t
+it_nextidx(void)
+{
+	if (tidx == CTF_MAX_TYPE)
+		errx(1, "too many types");
+
+	return ++tidx;
+}
+
 struct itype *
 it_new(uint64_t index, size_t off, const char *name, uint32_t size,
     uint16_t enc, uint64_t ref, uint16_t type, unsigned int flags)
@@ -224,6 +268,17 @@ it_new(uint64_t index, size_t off, const char *name, uint32_t size,
 	return it;
 }
 
+/*
+ * Make a type of the parent CTF available to the merge of parsed types.
+ */
+void
+it_parent_insert(struct itype *it)
+{
+	assert(it->it_flags & ITF_PARENT);
+
+	RB_INSERT(itype_tree, &itypet[it->it_type], it);
+}
+
 struct itype *
 it_dup(struct itype *it)
 {
@@ -346,6 +401,20 @@ it_cmp(struct itype *a, struct itype *b)
 	return ma != mb;
 }
 
+/*
+ * Compare two types of the same kind for the type trees.  Pairs
+ * matched by a previous comparison must be forgotten, otherwise
+ * it_cmp() would order them by generation and miss duplicates.
+ */
+int
+it_tree_cmp(struct itype *a, struct itype *b)
+{
+	itype_gen_start = itype_gen + 1;
+	itype_gen = itype_gen_start + 1;
+
+	return it_cmp(a, b);
+}
+
 int
 it_name_cmp(struct itype *a, struct itype *b)
 {
@@ -399,6 +468,7 @@ im_new(const char *name, size_t ref, size_t off)
 	im->im_off = off;
 	im->im_refp = NULL;
 	if (name == NULL) {
+		im->im_name[0] = '\0';
 		im->im_flags = IMF_ANON;
 	} else {
 		size_t n;
@@ -595,10 +665,167 @@ cu_merge(struct dwcu *dcu, struct itype_queue *cutq)
 
 	/* Update global index to match removed entries. */
 	it = TAILQ_LAST(&itypeq, itype_queue);
-	while (it->it_flags & (ITF_FUNC|ITF_OBJ))
+	while (it != NULL && it->it_flags & (ITF_FUNC|ITF_OBJ))
 		it = TAILQ_PREV(it, itype_queue, it_next);
 
-	tidx = it->it_idx;
+	/* All types might be found in the parent. */
+	tidx = (it != NULL) ? it->it_idx : tbase;
+}
+
+/*
+ * Pending types of a walk of the type graph, used as a stack for a
+ * depth-first walk and as a queue for a breadth-first one.
+ */
+struct itwalk {
+	struct itype	**iw_its;
+	size_t		  iw_len;
+	size_t		  iw_size;
+	size_t		  iw_head;	/* next type to visit, BFS */
+	uint16_t	 *iw_newidx;	/* new ID of each type, by old ID */
+	uint16_t	  iw_last;	/* last assigned ID */
+	int		  iw_order;
+};
+
+static void
+iw_push(struct itwalk *iw, struct itype *it)
+{
+	if (iw->iw_len == iw->iw_size) {
+		iw->iw_size = MAX(iw->iw_size * 2, 1024);
+		iw->iw_its = xreallocarray(iw->iw_its, iw->iw_size,
+		    sizeof(*iw->iw_its));
+	}
+	iw->iw_its[iw->iw_len++] = it;
+}
+
+/*
+ * Queue the types referenced by ``it''.  With a breadth-first walk
+ * types are numbered when queued so that members of a struct get
+ * consecutive IDs.  With a depth-first walk they are pushed in reverse
+ * order so that the first member is the first one visited.
+ */
+static void
+iw_children(struct itwalk *iw, struct itype *it)
+{
+	struct itype		*cit;
+	struct imember		*im;
+	size_t			 start = iw->iw_len, end;
+
+	cit = it->it_refp;
+	im = TAILQ_FIRST(&it->it_members);
+	for (;;) {
+		/*
+		 * Symbols without type information refer to themselves,
+		 * types of the parent keep their ID.
+		 */
+		if (cit != NULL &&
+		    !(cit->it_flags & (ITF_FUNC|ITF_OBJ|ITF_PARENT))) {
+			assert(cit->it_idx <= tidx);
+			if (iw->iw_newidx[cit->it_idx] == 0) {
+				if (iw->iw_order == TYPE_ORDER_BFS)
+					iw->iw_newidx[cit->it_idx] =
+					    ++iw->iw_last;
+				iw_push(iw, cit);
+			}
+		}
+		if (im == NULL)
+			break;
+		cit = im->im_refp;
+		im = TAILQ_NEXT(im, im_next);
+	}
+
+	if (iw->iw_order == TYPE_ORDER_DFS) {
+		for (end = iw->iw_len; start + 1 < end; start++, end--) {
+			cit = iw->iw_its[start];
+			iw->iw_its[start] = iw->iw_its[end - 1];
+			iw->iw_its[end - 1] = cit;
+		}
+	}
+}
+
+/*
+ * Number all the types reachable from ``it''.  Only its references
+ * are numbered if it is a symbol.
+ */
+static void
+iw_walk(struct itwalk *iw, struct itype *it)
+{
+	if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+		iw_children(iw, it);
+	else if (iw->iw_newidx[it->it_idx] == 0) {
+		if (iw->iw_order == TYPE_ORDER_BFS)
+			iw->iw_newidx[it->it_idx] = ++iw->iw_last;
+		iw_push(iw, it);
+	}
+
+	if (iw->iw_order == TYPE_ORDER_BFS) {
+		while (iw->iw_head < iw->iw_len)
+			iw_children(iw, iw->iw_its[iw->iw_head++]);
+		iw->iw_head = iw->iw_len = 0;
+		return;
+	}
+
+	while (iw->iw_len > 0) {
+		it = iw->iw_its[--iw->iw_len];
+		if (iw->iw_newidx[it->it_idx] != 0)
+			continue;
+		iw->iw_newidx[it->it_idx] = ++iw->iw_last;
+		iw_children(iw, it);
+	}
+}
+
+/*
+ * Renumber types in the order they are reached from functions and
+ * data objects, so that types referencing each other end up close in
+ * the emitted section.  Types unreachable from symbols are walked
+ * last, in their original order, so each of them is followed by the
+ * types only it references.  "void" keeps the first ID.
+ */
+void
+types_reorder(int order)
+{
+	struct itwalk		 iw;
+	struct itype		*it, **byidx;
+	unsigned int		 i;
+
+	if (order == TYPE_ORDER_NONE)
+		return;
+
+	memset(&iw, 0, sizeof(iw));
+	iw.iw_order = order;
+	iw.iw_newidx = xcalloc(tidx + 1, sizeof(*iw.iw_newidx));
+	iw.iw_last = tbase;
+	if (!(void_it->it_flags & ITF_PARENT))
+		iw.iw_newidx[void_it->it_idx] = ++iw.iw_last;
+
+	TAILQ_FOREACH(it, &ifuncq, it_symb)
+		iw_walk(&iw, it);
+	TAILQ_FOREACH(it, &iobjq, it_symb)
+		iw_walk(&iw, it);
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+			continue;
+		iw_walk(&iw, it);
+	}
+	assert(iw.iw_last == tidx);
+	free(iw.iw_its);
+
+	/* Apply new IDs and sort the queue of types accordingly. */
+	byidx = xcalloc(tidx + 1, sizeof(*byidx));
+	TAILQ_FOREACH(it, &itypeq, it_next) {
+		if (it->it_flags & (ITF_FUNC|ITF_OBJ))
+			continue;
+		it->it_idx = iw.iw_newidx[it->it_idx];
+		byidx[it->it_idx] = it;
+	}
+	for (i = tbase + 1; i <= tidx; i++) {
+		TAILQ_REMOVE(&itypeq, byidx[i], it_next);
+		TAILQ_INSERT_TAIL(&itypeq, byidx[i], it_next);
+	}
+	if (long_tidx > tbase)
+		long_tidx = iw.iw_newidx[long_tidx];
+
+	free(byidx);
+	free(iw.iw_newidx);
 }
 
 /*
@@ -793,7 +1020,7 @@ parse_base(struct dwdie *die, size_t psz)
 		return (NULL);
 	}
 
-	it = it_new(++tidx, die->die_offset, enc2name(enc), bits,
+	it = it_new(it_nextidx(), die->die_offset, enc2name(enc), bits,
 	    encoding, 0, type, 0);
 
 	return it;
@@ -825,10 +1052,10 @@ parse_refers(struct dwdie *die, size_t psz, int type)
 		}
 	}
 
-	it = it_new(++tidx, die->die_offset, name, size, 0, ref, type,
+	it = it_new(it_nextidx(), die->die_offset, name, size, 0, ref, type,
 	    ITF_UNRES);
 
-	if (it->it_ref == 0 && (it->it_size == sizeof(void *) ||
+	if (it->it_ref == 0 && (it->it_size == psz ||
 	    type == CTF_K_CONST || type == CTF_K_VOLATILE ||
 	    type == CTF_K_POINTER)) {
 		/* Work around GCC/clang not emiting a type for void */
@@ -862,7 +1089,7 @@ parse_array(struct dwdie *die, size_t psz)
 		}
 	}
 
-	it = it_new(++tidx, die->die_offset, name, 0, 0, ref, CTF_K_ARRAY,
+	it = it_new(it_nextidx(), die->die_offset, name, 0, 0, ref, CTF_K_ARRAY,
 	    ITF_UNRES);
 
 	subparse_subrange(die, psz, it);
@@ -893,7 +1120,8 @@ parse_enum(struct dwdie *die, size_t psz)
 		}
 	}
 
-	it = it_new(++tidx, die->die_offset, name, size, 0, 0, CTF_K_ENUM, 0);
+	it = it_new(it_nextidx(), die->die_offset, name, size, 0, 0,
+	    CTF_K_ENUM, 0);
 
 	subparse_enumerator(die, psz, it);
 
@@ -1014,7 +1242,7 @@ parse_struct(struct dwdie *die, size_t psz, int type, size_t off)
 		}
 	}
 
-	it = it_new(++tidx, die->die_offset, name, size, 0, 0, type, 0);
+	it = it_new(it_nextidx(), die->die_offset, name, size, 0, 0, type, 0);
 
 	subparse_member(die, psz, it, off);
 
@@ -1105,6 +1333,7 @@ subparse_arguments(struct dwdie *die, size_t psz, struct itype *it)
 {
 	struct imember *im;
 	struct dwaval *dav;
+	const char *name;
 	size_t ref = 0;
 
 	assert(it->it_type == CTF_K_FUNCTION);
@@ -1140,8 +1369,12 @@ subparse_arguments(struct dwdie *die, size_t psz, struct itype *it)
 
 		it->it_flags |= ITF_UNRES_MEMB;
 
+		name = NULL;
 		STAILQ_FOREACH(dav, &die->die_avals, dav_next) {
 			switch (dav->dav_dat->dat_attr) {
+			case DW_AT_name:
+				name = dav2str(dav);
+				break;
 			case DW_AT_type:
 				ref = dav2val(dav, psz);
 				break;
@@ -1152,7 +1385,8 @@ subparse_arguments(struct dwdie *die, size_t psz, struct itype *it)
 			}
 		}
 
-		im = im_new(NULL, ref, 0);
+		/* Only BTF functions need the name of their arguments. */
+		im = im_new((it->it_flags & ITF_FUNC) ? name : NULL, ref, 0);
 		assert(it->it_nelems < UINT_MAX);
 		it->it_nelems++;
 		TAILQ_INSERT_TAIL(&it->it_members, im, im_next);
@@ -1231,8 +1465,8 @@ parse_funcptr(struct dwdie *die, size_t psz)
 		}
 	}
 
-	it = it_new(++tidx, die->die_offset, name, 0, 0, ref, CTF_K_FUNCTION,
-	    ITF_UNRES);
+	it = it_new(it_nextidx(), die->die_offset, name, 0, 0, ref,
+	    CTF_K_FUNCTION, ITF_UNRES);
 
 	subparse_arguments(die, psz, it);
 
@@ -20,86 +20,339 @@
 
 #include <sys/types.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/queue.h>
 
 #include <assert.h>
+#include <err.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "xmalloc.h"
 #include "pool.h"
 
+#define MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
 #define MAXIMUM(a, b)	(((a) > (b)) ? (a) : (b))
+#define ROUNDUP(x, y)	((((x) + (y) - 1) / (y)) * (y))
+
+#define POOL_SLABMAX	(64 * 1024 * 1024)	/* largest slab, in bytes */
 
 struct pool_item {
 	SLIST_ENTRY(pool_item) pi_list;
 };
 
+/*
+ * Items are carved from anonymous mappings with a bump pointer, so that
+ * pages are only touched once items are handed out.
+ */
+struct pool_slab {
+	SLIST_ENTRY(pool_slab)	 ps_list;
+	size_t			 ps_len;	/* size of the mapping */
+};
+
+#define POOL_SLABHDR	ROUNDUP(sizeof(struct pool_slab), 16)
+
+/*
+ * Each thread keeps free items of every pool in a magazine, so that
+ * getting and putting items does not take the lock of the pool.  Half
+ * a magazine is moved at once when it is empty or full.  Items freed
+ * by another thread than the one which got them simply end up in its
+ * magazine.  A thread handing its objects to another one, or exiting,
+ * gives its cached items back with pool_cache_flush().
+ */
+#define POOL_MAX	16		/* # of pools with magazines */
+#define POOL_MAGSIZE	64		/* # of items per magazine */
+
+struct pool_mag {
+	unsigned int	 pm_n;		/* # of cached items */
+	void		*pm_items[POOL_MAGSIZE];
+};
+
+struct pool_cache {
+	struct pool_mag	 pc_mags[POOL_MAX];	/* indexed by pr_id */
+};
+
+static void	 pool_grow(struct pool *);
+static void	*pool_get_locked(struct pool *);
+static void	 pool_put_locked(struct pool *, void *);
+static struct pool_mag *pool_mag(struct pool *);
+static void	 pool_drain(struct pool *, struct pool_mag *, unsigned int);
+static void	 pool_cache_free(void *);
+static void	 pool_key_init(void);
+
 STAILQ_HEAD(, pool) pool_head = STAILQ_HEAD_INITIALIZER(pool_head);
 
+static struct pool	*pool_ids[POOL_MAX];
+static unsigned int	 pool_nids;
+static pthread_key_t	 pool_key;
+static pthread_once_t	 pool_once = PTHREAD_ONCE_INIT;
+static int		 pool_keyed;	/* pool_key is valid */
+static __thread struct pool_cache *pool_cache;	/* of the current thread */
+
 void
 pool_init(struct pool *pp, const char *name, size_t nmemb, size_t size)
 {
 	size = MAXIMUM(size, sizeof(struct pool_item));
 
 	SLIST_INIT(&pp->pr_free);
+	SLIST_INIT(&pp->pr_slabs);
 	pp->pr_name = name;
-	pp->pr_nmemb = nmemb;
+	pp->pr_bump = NULL;
+	pp->pr_end = NULL;
+	pp->pr_nmemb = MINIMUM(nmemb, POOL_SLABMAX / size);
 	pp->pr_size = size;
 	pp->pr_nitems = 0;
 	pp->pr_nfree = 0;
+	pp->pr_nslabs = 0;
+	pthread_mutex_init(&pp->pr_mtx, NULL);
+
+	/* Pools are initialized before other threads are started. */
+	pthread_once(&pool_once, pool_key_init);
+	pp->pr_id = POOL_MAX;
+	if (pool_keyed && pool_nids < POOL_MAX) {
+		pp->pr_id = pool_nids++;
+		pool_ids[pp->pr_id] = pp;
+	}
 
 	STAILQ_INSERT_TAIL(&pool_head, pp, pr_list);
 }
 
-void *
-pool_get(struct pool *pp)
+/*
+ * Make the next slab of ``pp'' big enough for ``nitems'' items, when
+ * their number can be estimated from the size of the input.
+ */
+void
+pool_sizehint(struct pool *pp, size_t nitems)
 {
-	struct pool_item *pi;
+	nitems = MINIMUM(nitems, POOL_SLABMAX / pp->pr_size);
+	pthread_mutex_lock(&pp->pr_mtx);
+	pp->pr_nmemb = MAXIMUM(pp->pr_nmemb, nitems);
+	pthread_mutex_unlock(&pp->pr_mtx);
+}
 
-	if (SLIST_EMPTY(&pp->pr_free)) {
-		char *p;
-		size_t i;
+/*
+ * Give the slabs of ``pp'' back to the system if none of its items is
+ * in use anymore, including in the magazines of other threads.
+ */
+void
+pool_release(struct pool *pp)
+{
+	struct pool_slab *ps;
+	struct pool_mag *pm;
 
-		p = xreallocarray(NULL, pp->pr_nmemb, pp->pr_size);
-		for (i = 0; i < pp->pr_nmemb; i++) {
-			pi = (struct pool_item *)p;
-			SLIST_INSERT_HEAD(&pp->pr_free, pi, pi_list);
-			p += pp->pr_size;
-		}
-		pp->pr_nitems += pp->pr_nmemb;
-		pp->pr_nfree += pp->pr_nmemb;
+	if ((pm = pool_mag(pp)) != NULL)
+		pool_drain(pp, pm, pm->pm_n);
+
+	pthread_mutex_lock(&pp->pr_mtx);
+	if (pp->pr_nfree != pp->pr_nitems) {
+		pthread_mutex_unlock(&pp->pr_mtx);
+		return;
 	}
 
+	while ((ps = SLIST_FIRST(&pp->pr_slabs)) != NULL) {
+		SLIST_REMOVE_HEAD(&pp->pr_slabs, ps_list);
+		munmap(ps, ps->ps_len);
+	}
+	SLIST_INIT(&pp->pr_free);
+	pp->pr_bump = NULL;
+	pp->pr_end = NULL;
+	pp->pr_nitems = 0;
+	pp->pr_nfree = 0;
+	pp->pr_nslabs = 0;
+	pthread_mutex_unlock(&pp->pr_mtx);
+}
+
+/*
+ * Map a new slab, each one twice as big as the previous one so that
+ * the number of refills only grows with the log of the input size.
+ */
+static void
+pool_grow(struct pool *pp)
+{
+	struct pool_slab *ps;
+	size_t len;
+
+	len = ROUNDUP(POOL_SLABHDR + pp->pr_nmemb * pp->pr_size,
+	    (size_t)getpagesize());
+	ps = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE,
+	    -1, 0);
+	if (ps == MAP_FAILED)
+		err(1, "mmap");
+
+	ps->ps_len = len;
+	SLIST_INSERT_HEAD(&pp->pr_slabs, ps, ps_list);
+	pp->pr_bump = (char *)ps + POOL_SLABHDR;
+	pp->pr_end = (char *)ps + len;
+	pp->pr_nslabs++;
+
+	pp->pr_nmemb = MINIMUM(pp->pr_nmemb * 2, POOL_SLABMAX / pp->pr_size);
+}
+
+static void *
+pool_get_locked(struct pool *pp)
+{
+	struct pool_item *pi;
+
 	pi = SLIST_FIRST(&pp->pr_free);
-	SLIST_REMOVE_HEAD(&pp->pr_free, pi_list);
-	pp->pr_nfree--;
+	if (pi != NULL) {
+		SLIST_REMOVE_HEAD(&pp->pr_free, pi_list);
+		pp->pr_nfree--;
+		return pi;
+	}
+
+	if ((size_t)(pp->pr_end - pp->pr_bump) < pp->pr_size)
+		pool_grow(pp);
+
+	pi = (struct pool_item *)pp->pr_bump;
+	pp->pr_bump += pp->pr_size;
+	pp->pr_nitems++;
 
 	return pi;
 }
 
-void
-pool_put(struct pool *pp, void *p)
+static void
+pool_put_locked(struct pool *pp, void *p)
 {
 	struct pool_item *pi = (struct pool_item *)p;
 
-	if (pi == NULL)
-		return;
-
 	assert(pp->pr_nfree < pp->pr_nitems);
 
 	SLIST_INSERT_HEAD(&pp->pr_free, pi, pi_list);
 	pp->pr_nfree++;
 }
 
+static void
+pool_key_init(void)
+{
+	pool_keyed = (pthread_key_create(&pool_key, pool_cache_free) == 0);
+}
+
+/*
+ * Magazine of the current thread for ``pp'', NULL if it has none.
+ */
+static struct pool_mag *
+pool_mag(struct pool *pp)
+{
+	struct pool_cache *pc;
+
+	if (pp->pr_id >= POOL_MAX)
+		return NULL;
+
+	pc = pool_cache;
+	if (pc == NULL) {
+		pc = xcalloc(1, sizeof(*pc));
+		if (pthread_setspecific(pool_key, pc) != 0) {
+			free(pc);
+			return NULL;
+		}
+		pool_cache = pc;
+	}
+
+	return &pc->pc_mags[pp->pr_id];
+}
+
+/*
+ * Move the last ``n'' items of the magazine ``pm'' back to ``pp''.
+ */
+static void
+pool_drain(struct pool *pp, struct pool_mag *pm, unsigned int n)
+{
+	if (n == 0)
+		return;
+
+	pthread_mutex_lock(&pp->pr_mtx);
+	while (n-- > 0)
+		pool_put_locked(pp, pm->pm_items[--pm->pm_n]);
+	pthread_mutex_unlock(&pp->pr_mtx);
+}
+
+/*
+ * Give the items cached by the current thread back to their pools.
+ */
+void
+pool_cache_flush(void)
+{
+	struct pool_cache *pc;
+	unsigned int i;
+
+	if ((pc = pool_cache) == NULL)
+		return;
+
+	for (i = 0; i < pool_nids; i++)
+		pool_drain(pool_ids[i], &pc->pc_mags[i], pc->pc_mags[i].pm_n);
+}
+
+/* Called when a thread with a cache exits. */
+static void
+pool_cache_free(void *arg)
+{
+	struct pool_cache *pc = arg;
+	unsigned int i;
+
+	for (i = 0; i < pool_nids; i++)
+		pool_drain(pool_ids[i], &pc->pc_mags[i], pc->pc_mags[i].pm_n);
+	free(pc);
+}
+
+void *
+pool_get(struct pool *pp)
+{
+	struct pool_mag *pm;
+	unsigned int i;
+	void *p;
+
+	pm = pool_mag(pp);
+	if (pm == NULL) {
+		pthread_mutex_lock(&pp->pr_mtx);
+		p = pool_get_locked(pp);
+		pthread_mutex_unlock(&pp->pr_mtx);
+		return p;
+	}
+
+	if (pm->pm_n == 0) {
+		/* Filled backward to hand out fresh items in address order. */
+		pthread_mutex_lock(&pp->pr_mtx);
+		for (i = POOL_MAGSIZE / 2; i > 0; i--)
+			pm->pm_items[i - 1] = pool_get_locked(pp);
+		pthread_mutex_unlock(&pp->pr_mtx);
+		pm->pm_n = POOL_MAGSIZE / 2;
+	}
+
+	return pm->pm_items[--pm->pm_n];
+}
+
+void
+pool_put(struct pool *pp, void *p)
+{
+	struct pool_mag *pm;
+
+	if (p == NULL)
+		return;
+
+	pm = pool_mag(pp);
+	if (pm == NULL) {
+		pthread_mutex_lock(&pp->pr_mtx);
+		pool_put_locked(pp, p);
+		pthread_mutex_unlock(&pp->pr_mtx);
+		return;
+	}
+
+	if (pm->pm_n == POOL_MAGSIZE)
+		pool_drain(pp, pm, POOL_MAGSIZE / 2);
+	pm->pm_items[pm->pm_n++] = p;
+}
+
 void
 pool_dump(void)
 {
 	struct pool *pp;
 
+	pool_cache_flush();
 	STAILQ_FOREACH(pp, &pool_head, pr_list)
-		printf("%s: %zd items, %zd free\n", pp->pr_name, pp->pr_nitems,
-		    pp->pr_nfree);
+		printf("%s: %zd items, %zd free, %zd slabs\n", pp->pr_name,
+		    pp->pr_nitems, pp->pr_nfree, pp->pr_nslabs);
 }
 #endif /* NOPOOL */
@@ -25,13 +25,22 @@ struct pool {
 	STAILQ_ENTRY(pool)	 pr_list;	/* list of all pools */
 	const char		*pr_name;	/* identifier */
 	SLIST_HEAD(, pool_item)  pr_free;	/* free list */
-	size_t			 pr_nmemb;	/* # of items per allocation */
+	SLIST_HEAD(, pool_slab)  pr_slabs;	/* mapped slabs */
+	char			*pr_bump;	/* next item never handed out */
+	char			*pr_end;	/* end of the current slab */
+	size_t			 pr_nmemb;	/* # of items of the next slab */
 	size_t			 pr_size;	/* size of an item */
 	size_t			 pr_nitems;	/* # of available items */
 	size_t			 pr_nfree;	/* # items on the free list */
+	size_t			 pr_nslabs;	/* # of mapped slabs */
+	pthread_mutex_t		 pr_mtx;	/* protects all of the above */
+	unsigned int		 pr_id;		/* magazine index */
 };
 
 void	 pool_init(struct pool *, const char *, size_t, size_t);
+void	 pool_sizehint(struct pool *, size_t);
+void	 pool_release(struct pool *);
+void	 pool_cache_flush(void);
 void	*pool_get(struct pool *);
 void	 pool_put(struct pool *, void *);
 void	 pool_dump(void);
@@ -0,0 +1,143 @@
+#!/usr/bin/env python
+#
+# Describe the types of a BTF section without their IDs, so that it
+# can be compared with an expected output.
+#
+# usage: btfdesc.py file
+#
+# Every type is printed, one per line, after checking that the section
+# is well formed: its parts are in bounds, every type is complete and
+# refers to existing types and strings.
+
+import struct
+import sys
+
+BTF_MAGIC = 0xeb9f
+BTF_HDR = '<HBBIIIII'
+
+BTF_KIND_INT = 1
+BTF_KIND_PTR = 2
+BTF_KIND_ARRAY = 3
+BTF_KIND_STRUCT = 4
+BTF_KIND_UNION = 5
+BTF_KIND_ENUM = 6
+BTF_KIND_FWD = 7
+BTF_KIND_FUNC = 12
+BTF_KIND_FUNC_PROTO = 13
+BTF_KIND_VAR = 14
+BTF_KIND_FLOAT = 16
+BTF_KIND_ENUM64 = 19
+
+REFKINDS = (BTF_KIND_PTR, 8, 9, 10, 11)  # typedef, volatile, const, restrict
+
+class BTF(object):
+    def __init__(self, path):
+        d = open(path, 'rb').read()
+        (magic, version, flags, hdrlen, typeoff, typelen, stroff,
+         strlen) = struct.unpack_from(BTF_HDR, d, 0)
+        if magic != BTF_MAGIC or version != 1:
+            sys.exit('%s: bad magic' % path)
+        if hdrlen + max(typeoff + typelen, stroff + strlen) != len(d):
+            sys.exit('%s: bad size' % path)
+        self.path = path
+        self.strs = d[hdrlen + stroff:hdrlen + stroff + strlen]
+        self.types = {}
+        self._load(d[hdrlen + typeoff:hdrlen + typeoff + typelen])
+        for tid in self.types:
+            self.desc(tid)
+
+    def name(self, off):
+        if off >= len(self.strs):
+            sys.exit('%s: bad name offset %d' % (self.path, off))
+        end = self.strs.index(b'\0', off)
+        return self.strs[off:end].decode()
+
+    def _load(self, b):
+        off, tid = 0, 1
+        while off < len(b):
+            name, info, size = struct.unpack_from('<III', b, off)
+            off += 12
+            kind, vlen = info >> 24, info & 0xffff
+            extra = None
+            if kind == BTF_KIND_INT:
+                extra = struct.unpack_from('<I', b, off)[0]
+                off += 4
+            elif kind == BTF_KIND_ARRAY:
+                extra = struct.unpack_from('<III', b, off)
+                off += 12
+            elif kind in (BTF_KIND_STRUCT, BTF_KIND_UNION):
+                extra = []
+                for i in range(vlen):
+                    n, t, o = struct.unpack_from('<III', b, off)
+                    off += 12
+                    extra.append((self.name(n), t, o))
+            elif kind == BTF_KIND_ENUM:
+                extra = []
+                for i in range(vlen):
+                    n, v = struct.unpack_from('<Ii', b, off)
+                    off += 8
+                    extra.append((self.name(n), v))
+            elif kind == BTF_KIND_ENUM64:
+                extra = []
+                for i in range(vlen):
+                    n, lo, hi = struct.unpack_from('<III', b, off)
+                    off += 12
+                    v = (hi << 32) | lo
+                    if info & 0x80000000 and v >= 1 << 63:
+                        v -= 1 << 64
+                    extra.append((self.name(n), v))
+            elif kind == BTF_KIND_FUNC_PROTO:
+                extra = []
+                for i in range(vlen):
+                    n, t = struct.unpack_from('<II', b, off)
+                    off += 8
+                    extra.append((self.name(n), t))
+            elif kind == BTF_KIND_VAR:
+                extra = struct.unpack_from('<I', b, off)[0]
+                off += 4
+            elif kind not in REFKINDS + (BTF_KIND_FWD, BTF_KIND_FUNC,
+                BTF_KIND_FLOAT):
+                sys.exit('%s: bad kind %d' % (self.path, kind))
+            self.types[tid] = (kind, self.name(name), vlen, size, extra)
+            tid += 1
+        if off != len(b):
+            sys.exit('%s: truncated type' % self.path)
+
+    def desc(self, tid, seen=()):
+        if tid == 0:
+            return '-'
+        if tid not in self.types:
+            sys.exit('%s: bad type %d' % (self.path, tid))
+        kind, name, vlen, size, extra = self.types[tid]
+        if tid in seen:
+            return '%d:%s' % (kind, name)
+        seen = seen + (tid,)
+        if kind in REFKINDS:
+            return '%d:%s->%s' % (kind, name, self.desc(size, seen))
+        if kind == BTF_KIND_FUNC:
+            return '%d:%s:%d:%s' % (kind, name, vlen, self.desc(size, seen))
+        if kind == BTF_KIND_FUNC_PROTO:
+            return '%s(%s)' % (self.desc(size, seen),
+                ','.join('%s:%s' % (n, self.desc(t, seen))
+                for n, t in extra))
+        if kind == BTF_KIND_VAR:
+            return '%d:%s:%d:%s' % (kind, name, extra, self.desc(size, seen))
+        if kind == BTF_KIND_ARRAY:
+            return '%s[%s:%d]' % (self.desc(extra[0], seen),
+                self.desc(extra[1], seen), extra[2])
+        if kind in (BTF_KIND_STRUCT, BTF_KIND_UNION):
+            return '%d:%s:%d{%s}' % (kind, name, size,
+                ';'.join('%s:%s@%d' % (n, self.desc(t, seen), o)
+                for n, t, o in extra))
+        if kind in (BTF_KIND_ENUM, BTF_KIND_ENUM64):
+            return '%d:%s:%d{%s}' % (kind, name, size,
+                ';'.join('%s=%d' % m for m in extra))
+        return '%d:%s:%d:%s' % (kind, name, size, extra)
+
+def main(argv):
+    btf = BTF(argv[0])
+    for tid in sorted(btf.types):
+        print(btf.desc(tid))
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
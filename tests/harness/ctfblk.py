@@ -0,0 +1,65 @@
+#!/usr/bin/env python
+#
+# Check the file written with -b against its CTF section.
+#
+# usage: ctfblk.py blockfile file
+#
+# The blocks must inflate to the uncompressed data of ``file'' and
+# every type block must start with the type it gives.
+
+import struct
+import sys
+import zlib
+
+from ctfdesc import CTF, CTF_CHILD_FIRST, CTF_F_COMPRESS
+
+CTF_BLK_MAGIC = 0xcfb1
+CTF_BLK_HDR = '<HBBIII'
+CTF_BLK_ENT = '<IIIIII'
+
+def check(cond, msg):
+    if not cond:
+        sys.exit('blocks: %s' % msg)
+
+def main(argv):
+    d = open(argv[0], 'rb').read()
+    ctf = CTF(argv[1])
+    magic, version, pad, blksize, nblocks, res = \
+        struct.unpack_from(CTF_BLK_HDR, d, 0)
+    check(magic == CTF_BLK_MAGIC and version == 1, 'bad magic')
+    check(nblocks >= 2, 'bad number of blocks')
+
+    off = struct.calcsize(CTF_BLK_HDR)
+    hdr = bytearray(ctf.hdr)
+    hdr[3] = ctf.flags & ~CTF_F_COMPRESS
+    check(d[off:off + len(hdr)] == bytes(hdr), 'header differs')
+    off += len(hdr)
+
+    body = b''
+    zpos = off + nblocks * struct.calcsize(CTF_BLK_ENT)
+    tid = CTF_CHILD_FIRST if ctf.parname else 1
+    for i in range(nblocks):
+        boff, blen, zoff, zlen, first, ntypes = \
+            struct.unpack_from(CTF_BLK_ENT, d, off)
+        off += struct.calcsize(CTF_BLK_ENT)
+        check(boff == len(body) and zoff == zpos, 'block %d misplaced' % i)
+        data = zlib.decompress(d[zoff:zoff + zlen])
+        check(len(data) == blen, 'block %d has a bad size' % i)
+        body += data
+        zpos += zlen
+        if i == 0:
+            check(first == 0 and blen == ctf.typeoff, 'bad first block')
+        elif i == nblocks - 1:
+            check(first == 0 and boff == ctf.stroff, 'bad last block')
+        else:
+            check(first == tid and ctf.offsets[first] == boff,
+                'block %d does not start with type %d' % (i, tid))
+            tid += ntypes
+    check(zpos == len(d), 'bad size')
+    check(body == ctf.body, 'data differs')
+    check(tid - (CTF_CHILD_FIRST if ctf.parname else 1) == len(ctf.offsets),
+        'missing types')
+    print('%d blocks' % nblocks)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,165 @@
+#!/usr/bin/env python
+#
+# Describe the types of a raw CTF section without their IDs, so that
+# sections built differently can be compared.
+#
+# usage: ctfdesc.py [-p parent] [-t] file
+#
+# By default the types of the objects and functions are printed in the
+# order of the symbol table.  With -t every type is printed instead,
+# one per line.  Types of a child are resolved in its parent with -p.
+
+import struct
+import sys
+import zlib
+
+CTF_MAGIC = 0xcff1
+CTF_F_COMPRESS = 0x1
+CTF_HDR = '<HBBIIIIIIII'
+CTF_PARENT_MAX = 0x7fff
+CTF_CHILD_FIRST = CTF_PARENT_MAX + 2
+CTF_LSIZE_SENT = 0xffff
+CTF_LSTRUCT_THRESH = 8192
+
+CTF_K_INTEGER = 1
+CTF_K_FLOAT = 2
+CTF_K_POINTER = 3
+CTF_K_ARRAY = 4
+CTF_K_FUNCTION = 5
+CTF_K_STRUCT = 6
+CTF_K_UNION = 7
+CTF_K_ENUM = 8
+CTF_K_FORWARD = 9
+
+REFKINDS = (CTF_K_POINTER, 10, 11, 12, 13)  # typedef, volatile, const, restrict
+
+class CTF(object):
+    def __init__(self, path, parent=None):
+        d = open(path, 'rb').read()
+        hdr = struct.unpack_from(CTF_HDR, d, 0)
+        (magic, version, flags, self.parlabel, self.parname, lbloff,
+         self.objtoff, self.funcoff, self.typeoff, self.stroff,
+         strlen) = hdr
+        if magic != CTF_MAGIC:
+            sys.exit('%s: bad magic' % path)
+        self.hdr, self.flags = d[:struct.calcsize(CTF_HDR)], flags
+        body = d[struct.calcsize(CTF_HDR):]
+        if flags & CTF_F_COMPRESS:
+            body = zlib.decompress(body)
+        self.body = body
+        self.strs = body[self.stroff:self.stroff + strlen]
+        self.types = {}
+        self.offsets = {}
+        if parent is not None:
+            self.types.update(parent.types)
+        self._load(CTF_CHILD_FIRST if self.parname else 1)
+
+    def name(self, off):
+        end = self.strs.index(b'\0', off)
+        return self.strs[off:end].decode()
+
+    def _load(self, tid):
+        b, off = self.body, self.typeoff
+        while off < self.stroff:
+            self.offsets[tid] = off
+            name, info, size = struct.unpack_from('<IHH', b, off)
+            off += 8
+            kind, vlen = info >> 11, info & 0x3ff
+            ref = size
+            if kind not in REFKINDS + (CTF_K_FUNCTION,) and \
+                size == CTF_LSIZE_SENT:
+                hi, lo = struct.unpack_from('<II', b, off)
+                off += 8
+                size = (hi << 32) | lo
+            extra = None
+            if kind in (CTF_K_INTEGER, CTF_K_FLOAT):
+                extra = struct.unpack_from('<I', b, off)[0]
+                off += 4
+            elif kind == CTF_K_ARRAY:
+                extra = struct.unpack_from('<HHI', b, off)
+                off += 8
+            elif kind == CTF_K_FUNCTION:
+                extra = struct.unpack_from('<%dH' % vlen, b, off)
+                off += 2 * (vlen + (vlen & 1))
+            elif kind in (CTF_K_STRUCT, CTF_K_UNION):
+                extra = []
+                for i in range(vlen):
+                    if size >= CTF_LSTRUCT_THRESH:
+                        n, t, _, hi, lo = struct.unpack_from('<IHHII', b, off)
+                        off += 16
+                        extra.append((self.name(n), t, (hi << 32) | lo))
+                    else:
+                        n, t, o = struct.unpack_from('<IHH', b, off)
+                        off += 8
+                        extra.append((self.name(n), t, o))
+            elif kind == CTF_K_ENUM:
+                extra = []
+                for i in range(vlen):
+                    n, v = struct.unpack_from('<Ii', b, off)
+                    off += 8
+                    extra.append((self.name(n), v))
+            self.types[tid] = (kind, self.name(name), size, ref, extra)
+            tid += 1
+        self.ntypes = tid
+
+    def desc(self, tid, seen=()):
+        if tid == 0:
+            return '-'
+        kind, name, size, ref, extra = self.types[tid]
+        if tid in seen:
+            return '%d:%s' % (kind, name)
+        seen = seen + (tid,)
+        if kind in REFKINDS:
+            return '%d:%s->%s' % (kind, name, self.desc(ref, seen))
+        if kind == CTF_K_FUNCTION:
+            return '%s(%s)' % (self.desc(ref, seen),
+                ','.join(self.desc(a, seen) for a in extra))
+        if kind == CTF_K_ARRAY:
+            return '%s[%d]' % (self.desc(extra[0], seen), extra[2])
+        if kind in (CTF_K_STRUCT, CTF_K_UNION):
+            return '%d:%s:%d{%s}' % (kind, name, size,
+                ';'.join('%s:%s@%d' % (n, self.desc(t, seen), o)
+                for n, t, o in extra))
+        if kind == CTF_K_ENUM:
+            return '%d:%s{%s}' % (kind, name,
+                ';'.join('%s=%d' % m for m in extra))
+        return '%d:%s:%d:%s' % (kind, name, size, extra)
+
+    def symbols(self):
+        b, off = self.body, self.objtoff
+        while off < self.funcoff:
+            yield 'obj ' + self.desc(struct.unpack_from('<H', b, off)[0])
+            off += 2
+        while off < self.typeoff:
+            info = struct.unpack_from('<H', b, off)[0]
+            off += 2
+            kind, vlen = info >> 11, info & 0x3ff
+            if kind == 0 and vlen == 0:
+                yield 'func -'
+                continue
+            r = struct.unpack_from('<H', b, off)[0]
+            args = struct.unpack_from('<%dH' % vlen, b, off + 2)
+            off += 2 * (vlen + 1)
+            yield 'func %s(%s)' % (self.desc(r),
+                ','.join(self.desc(a) for a in args))
+
+def main(argv):
+    parent, alltypes = None, False
+    while len(argv) > 1 and argv[0] in ('-p', '-t'):
+        if argv[0] == '-p':
+            parent = CTF(argv[1])
+            argv = argv[2:]
+        else:
+            alltypes = True
+            argv = argv[1:]
+    ctf = CTF(argv[0], parent)
+    if alltypes:
+        first = CTF_CHILD_FIRST if ctf.parname else 1
+        for tid in range(first, ctf.ntypes):
+            print(ctf.desc(tid))
+    else:
+        for line in ctf.symbols():
+            print(line)
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
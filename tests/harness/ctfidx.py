@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+#
+# Check the index written with -i against its CTF section and list it.
+#
+# usage: ctfidx.py file index
+#
+# Named types are printed as "type kind name", then functions and
+# objects as "address func|obj description", in the order of the index.
+
+import struct
+import sys
+
+from ctfdesc import CTF
+
+CTF_IDX_MAGIC = 0xcf1d
+CTF_IDX_HDR = '<HBBIIIII'
+CTF_IDX_ENT = '<IHH'
+CTF_IDX_ADDR = '<QQII'
+
+def check(cond, msg):
+    if not cond:
+        sys.exit('index: %s' % msg)
+
+def main(argv):
+    ctf = CTF(argv[0])
+    d = open(argv[1], 'rb').read()
+    magic, version, pad, count, strlen, nfuncs, nobjs, res = \
+        struct.unpack_from(CTF_IDX_HDR, d, 0)
+    check(magic == CTF_IDX_MAGIC and version == 1, 'bad magic')
+    check(strlen == len(ctf.strs), 'bad string table size')
+    off = struct.calcsize(CTF_IDX_HDR)
+    esize = struct.calcsize(CTF_IDX_ENT)
+    asize = struct.calcsize(CTF_IDX_ADDR)
+    check(len(d) == off + count * esize + (nfuncs + nobjs) * asize,
+        'bad size')
+
+    ents = []
+    for i in range(count):
+        name, kind, tid = struct.unpack_from(CTF_IDX_ENT, d, off)
+        off += esize
+        check(tid in ctf.types, 'bad type %d' % tid)
+        check(ctf.types[tid][:2] == (kind, ctf.name(name)),
+            'type %d is not %d:%s' % (tid, kind, ctf.name(name)))
+        ents.append((kind, ctf.name(name).encode(), tid))
+    check(ents == sorted(ents), 'types not sorted')
+    named = [t for t in ctf.types if ctf.types[t][1] != '']
+    check(len(named) == count, 'missing types')
+    for kind, name, tid in ents:
+        print('type %d %s' % (kind, name.decode()))
+
+    syms = list(ctf.symbols())
+    for what, n in (('func', nfuncs), ('obj', nobjs)):
+        entries = [s for s in syms if s.startswith(what + ' ')]
+        addrs = []
+        for i in range(n):
+            value, size, index, pad = struct.unpack_from(CTF_IDX_ADDR, d,
+                off)
+            off += asize
+            check(index < len(entries), 'bad %s index %d' % (what, index))
+            addrs.append((value, index))
+        check(addrs == sorted(addrs), '%s not sorted' % what)
+        check(sorted(i for v, i in addrs) == list(range(len(entries))),
+            'missing %s' % what)
+        for value, index in addrs:
+            print('%016x %s' % (value, entries[index]))
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
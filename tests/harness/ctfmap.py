@@ -0,0 +1,46 @@
+#!/usr/bin/env python
+#
+# Check the file written with -m against its CTF section.
+#
+# usage: ctfmap.py mapfile file
+#
+# The mapped section must be the uncompressed copy of ``file'' and the
+# offset of every type must point to it.
+
+import struct
+import sys
+
+from ctfdesc import CTF, CTF_CHILD_FIRST, CTF_F_COMPRESS
+
+CTF_MAP_MAGIC = 0xcf3a
+CTF_MAP_HDR = '<HBBIIIIIII'
+
+def check(cond, msg):
+    if not cond:
+        sys.exit('map: %s' % msg)
+
+def main(argv):
+    d = open(argv[0], 'rb').read()
+    ctf = CTF(argv[1])
+    (magic, version, pad, align, ctfoff, ctflen, typesoff, ntypes, first,
+     res) = struct.unpack_from(CTF_MAP_HDR, d, 0)
+    check(magic == CTF_MAP_MAGIC and version == 1, 'bad magic')
+    check(align > 0 and ctfoff % align == 0 and typesoff % align == 0,
+        'unaligned parts')
+    check(ctfoff + ctflen <= typesoff and
+        len(d) == typesoff + 4 * ntypes, 'bad size')
+
+    hdr = bytearray(ctf.hdr)
+    hdr[3] = ctf.flags & ~CTF_F_COMPRESS
+    check(d[ctfoff:ctfoff + ctflen] == bytes(hdr) + ctf.body,
+        'section differs')
+
+    check(first == (CTF_CHILD_FIRST if ctf.parname else 1), 'bad first type')
+    check(ntypes == len(ctf.offsets), 'bad number of types')
+    offs = struct.unpack_from('<%dI' % ntypes, d, typesoff)
+    for i, off in enumerate(offs):
+        check(off == len(hdr) + ctf.offsets[first + i],
+            'bad offset of type %d' % (first + i))
+
+if __name__ == '__main__':
+    main(sys.argv[1:])
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Compare the string hash table used by ctfconv(1) with the one it
+ * replaced, hash.c, with keys looking like C identifiers.
+ */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+#include "../../htab.h"
+#include "../../xmalloc.h"
+
+#ifndef nitems
+#define nitems(_a)	(sizeof((_a)) / sizeof((_a)[0]))
+#endif
+
+#define NKEYS	200000
+#define NLOOPS	10
+
+static const char *words[] = {
+	"dev", "buf", "vnode", "proc", "mount", "softc", "attach", "detach",
+	"ioctl", "read", "write", "lock", "unlock", "queue", "entry", "list",
+	"head", "next", "prev", "count", "flags", "size", "addr", "len",
+};
+
+struct hent {
+	struct hash_entry	 he;
+};
+
+struct htent {
+	struct htab_entry	 he;
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char **
+keys_gen(unsigned int n, const char *suffix)
+{
+	char **keys, buf[128];
+	unsigned int i, x = 0x2545f491;
+
+	keys = xreallocarray(NULL, n, sizeof(*keys));
+	for (i = 0; i < n; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		snprintf(buf, sizeof(buf), "%s_%s_%s%u%s",
+		    words[x % nitems(words)], words[(x >> 8) % nitems(words)],
+		    words[(x >> 16) % nitems(words)], i, suffix);
+		keys[i] = xstrdup(buf);
+	}
+
+	return keys;
+}
+
+static void
+bench_hash(char **keys, char **misses, unsigned int n)
+{
+	struct hash *h;
+	struct hent *e;
+	unsigned int i, l, slot, found = 0;
+	double t0, t1, t2, t3;
+
+	h = hash_init(10);
+	if (h == NULL)
+		err(1, "hash_init");
+
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		if (hash_find(h, keys[i], &slot) != NULL)
+			continue;
+		e = xmalloc(sizeof(*e));
+		hash_insert(h, slot, &e->he, keys[i]);
+	}
+	t1 = now();
+	for (l = 0; l < NLOOPS; l++)
+		for (i = 0; i < n; i++)
+			found += (hash_find(h, keys[i], &slot) != NULL);
+	t2 = now();
+	for (l = 0; l < NLOOPS; l++)
+		for (i = 0; i < n; i++)
+			found += (hash_find(h, misses[i], &slot) != NULL);
+	t3 = now();
+
+	printf("hash.c  insert %6.1f ns  hit %6.1f ns  miss %6.1f ns  (%u)\n",
+	    (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / (n * NLOOPS),
+	    (t3 - t2) * 1e9 / (n * NLOOPS), found);
+}
+
+static void
+bench_htab(char **keys, char **misses, unsigned int n)
+{
+	struct htab *h;
+	struct htent *e;
+	unsigned int i, l, slot, found = 0;
+	size_t len;
+	double t0, t1, t2, t3;
+
+	h = htab_init(10);
+
+	/* Like hash.c, lengths are computed on every lookup. */
+	t0 = now();
+	for (i = 0; i < n; i++) {
+		len = strlen(keys[i]);
+		if (htab_find(h, keys[i], len, &slot) != NULL)
+			continue;
+		e = xmalloc(sizeof(*e));
+		htab_insert(h, slot, &e->he, keys[i], len);
+	}
+	t1 = now();
+	for (l = 0; l < NLOOPS; l++)
+		for (i = 0; i < n; i++)
+			found += (htab_find(h, keys[i], strlen(keys[i]),
+			    NULL) != NULL);
+	t2 = now();
+	for (l = 0; l < NLOOPS; l++)
+		for (i = 0; i < n; i++)
+			found += (htab_find(h, misses[i], strlen(misses[i]),
+			    NULL) != NULL);
+	t3 = now();
+
+	printf("htab.c  insert %6.1f ns  hit %6.1f ns  miss %6.1f ns  (%u)\n",
+	    (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / (n * NLOOPS),
+	    (t3 - t2) * 1e9 / (n * NLOOPS), found);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char **keys, **misses;
+	unsigned int n = NKEYS;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 10);
+
+	keys = keys_gen(n, "");
+	misses = keys_gen(n, "_t");
+
+	bench_hash(keys, misses, n);
+	bench_htab(keys, misses, n);
+
+	return 0;
+}
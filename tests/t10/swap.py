@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+#
+# Swap the addends of the .debug_info relocations of an x86-64 object
+# that point to the names given, so that only the relocations differ.
+#
+# usage: swap.py in.o out.o name1 name2
+
+import struct
+import sys
+
+d = bytearray(open(sys.argv[1], 'rb').read())
+shoff, = struct.unpack_from('<Q', d, 0x28)
+shentsize, shnum, shstrndx = struct.unpack_from('<HHH', d, 0x3a)
+
+def shdr(i):
+    return shoff + i * shentsize
+
+def section(i):
+    return struct.unpack_from('<QQ', d, shdr(i) + 24)
+
+def name(i):
+    off = section(shstrndx)[0]
+    n, = struct.unpack_from('<I', d, shdr(i))
+    return d[off + n:d.index(b'\0', off + n)].decode()
+
+idx = dict((name(i), i) for i in range(shnum))
+
+stroff = section(idx['.debug_str'])[0]
+def string(o):
+    return d[stroff + o:d.index(b'\0', stroff + o)].decode()
+
+off, size = section(idx['.rela.debug_info'])
+found = {}
+for o in range(off, off + size, 24):
+    addend, = struct.unpack_from('<q', d, o + 16)
+    s = string(addend)
+    if s in sys.argv[3:]:
+        found[s] = (o, addend)
+a, b = (found[s] for s in sys.argv[3:5])
+struct.pack_into('<q', d, a[0] + 16, b[1])
+struct.pack_into('<q', d, b[0] + 16, a[1])
+open(sys.argv[2], 'wb').write(d)
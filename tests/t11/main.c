@@ -0,0 +1,14 @@
+struct point {
+	int x;
+	int y;
+};
+
+int	norm1(struct point *);
+
+int
+main(void)
+{
+	struct point p = { 2, 3 };
+
+	return norm1(&p) != 5;
+}
@@ -0,0 +1,10 @@
+struct point {
+	int x;
+	int y;
+};
+
+int
+norm1(struct point *p)
+{
+	return p->x + p->y;
+}
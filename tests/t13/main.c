@@ -0,0 +1,50 @@
+typedef unsigned int	uint;
+
+enum color {
+	RED,
+	GREEN = 4,
+	BLUE
+};
+
+struct point {
+	int		 x;
+	int		 y;
+};
+
+union value {
+	long		 l;
+	char		 c[8];
+};
+
+struct node {
+	struct node	*next;
+	const char	*name;
+	volatile int	 flags;
+	enum color	 color;
+	union value	 v;
+	int		(*cb)(struct point *, ...);
+};
+
+struct node	 head;
+static uint	 count;
+
+int
+norm1(struct point *p)
+{
+	return p->x + p->y;
+}
+
+static int
+visit(struct node *n, int depth)
+{
+	count++;
+	return (n == 0) ? depth : visit(n->next, depth + 1);
+}
+
+int
+main(void)
+{
+	struct point p = { 2, 3 };
+
+	return visit(&head, 0) + norm1(&p) != 6;
+}
@@ -0,0 +1,9 @@
+#include "t.h"
+
+int	shape_draw(struct shape *, void *);
+
+int
+main(void)
+{
+	return shape_draw(0, 0);
+}
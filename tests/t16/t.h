@@ -0,0 +1,20 @@
+typedef unsigned long	 size_t;
+
+struct list {
+	struct list	*next;
+	const char	*name;
+};
+
+enum color {
+	RED,
+	GREEN,
+	BLUE,
+};
+
+struct shape {
+	enum color	 color;
+	size_t		 npoints;
+	int		 points[4][2];
+	struct list	 list;
+	int		(*draw)(struct shape *, void *);
+};
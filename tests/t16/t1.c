@@ -0,0 +1,9 @@
+#include "t.h"
+
+struct list	*head;
+
+int
+shape_draw(struct shape *s, void *arg)
+{
+	return s->draw(s, arg);
+}
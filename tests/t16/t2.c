@@ -0,0 +1,18 @@
+#include "t.h"
+
+union value {
+	long		 l;
+	double		 d;
+	struct shape	*s;
+};
+
+struct shape	 square;
+
+union value
+value_get(const struct list *l, volatile size_t *n)
+{
+	union value v;
+
+	v.l = (long)l->name + *n;
+	return v;
+}
@@ -0,0 +1,68 @@
+#!/usr/bin/env python
+#
+# Rewrite the RELA relocations of .debug_info of an x86-64 object as REL
+# ones, with their addends in place.  The .debug_str section symbol gets
+# a non-zero value so that a relocation applied twice changes the names.
+# With -e an empty REL section for .debug_info, smaller than an entry,
+# is put after the real one.
+
+import struct
+import sys
+
+R_X86_64_64 = 1
+R_X86_64_32 = 10
+SHT_REL = 9
+STT_SECTION = 3
+
+empty = len(sys.argv) > 1 and sys.argv[1] == '-e'
+if empty:
+    sys.argv.pop(1)
+
+d = bytearray(open(sys.argv[1], 'rb').read())
+shoff, = struct.unpack_from('<Q', d, 0x28)
+shentsize, shnum, shstrndx = struct.unpack_from('<HHH', d, 0x3a)
+
+def shdr(i):
+    return shoff + i * shentsize
+
+def name(i):
+    off, = struct.unpack_from('<Q', d, shdr(shstrndx) + 24)
+    n, = struct.unpack_from('<I', d, shdr(i))
+    return d[off + n:d.index(b'\0', off + n)].decode()
+
+idx = dict((name(i), i) for i in range(shnum))
+
+info = struct.unpack_from('<Q', d, shdr(idx['.debug_info']) + 24)[0]
+s = shdr(idx['.rela.debug_info'])
+off, size = struct.unpack_from('<QQ', d, s + 24)
+rels = [struct.unpack_from('<QQq', d, off + o) for o in range(0, size, 24)]
+for i, (roff, rinfo, addend) in enumerate(rels):
+    rtype = rinfo & 0xffffffff
+    if rtype == R_X86_64_64:
+        struct.pack_into('<q', d, info + roff, addend)
+    elif rtype == R_X86_64_32:
+        struct.pack_into('<I', d, info + roff, addend & 0xffffffff)
+    else:
+        sys.exit('unexpected relocation type %d' % rtype)
+    struct.pack_into('<QQ', d, off + i * 16, roff, rinfo)
+struct.pack_into('<I', d, s + 4, SHT_REL)
+struct.pack_into('<Q', d, s + 32, len(rels) * 16)
+struct.pack_into('<Q', d, s + 56, 16)
+
+s = shdr(idx['.symtab'])
+off, size = struct.unpack_from('<QQ', d, s + 24)
+for o in range(off, off + size, 24):
+    stinfo, = struct.unpack_from('<B', d, o + 4)
+    shndx, = struct.unpack_from('<H', d, o + 6)
+    if stinfo & 0xf == STT_SECTION and shndx == idx['.debug_str']:
+        struct.pack_into('<Q', d, o + 8, 1)
+
+if empty:
+    s = shdr(idx['.note.GNU-stack'])
+    assert idx['.note.GNU-stack'] > idx['.rela.debug_info']
+    struct.pack_into('<IQ', d, s + 4, SHT_REL, 0)
+    struct.pack_into('<QQII', d, s + 24, info, 8, idx['.symtab'],
+        idx['.debug_info'])
+    struct.pack_into('<Q', d, s + 56, 16)
+
+open(sys.argv[2], 'wb').write(d)
@@ -0,0 +1,9 @@
+struct longstructname {
+	int longmembername;
+};
+
+int
+longfunctionname(struct longstructname *a)
+{
+	return a->longmembername;
+}
@@ -0,0 +1,42 @@
+#!/usr/bin/env python
+#
+# Write an ar(5) archive of the given files, in the GNU format with the
+# names in a "//" member, or with -b in the BSD format with the names
+# following the headers.  BSD names of odd length leave the data of the
+# members at odd offsets.
+
+import os
+import sys
+
+def header(name, size):
+    return ('%-16s%-12d%-6d%-6d%-8o%-10d`\n' %
+        (name, 0, 0, 0, 0o644, size)).encode()
+
+def pad(data):
+    return data + b'\n' * (len(data) & 1)
+
+bsd = sys.argv[1] == '-b'
+if bsd:
+    sys.argv.pop(1)
+
+out = b'!<arch>\n'
+names = b''
+members = []
+for path in sys.argv[2:]:
+    name = os.path.basename(path)
+    data = open(path, 'rb').read()
+    if bsd:
+        out += header('#1/%d' % len(name), len(name) + len(data))
+        out += pad(name.encode() + data)
+    elif len(name) < 16:
+        members.append((header(name + '/', len(data)), data))
+    else:
+        members.append((header('/%d' % len(names), len(data)), data))
+        names += name.encode() + b'/\n'
+
+if names:
+    out += header('//', len(names)) + pad(names)
+for hdr, data in members:
+    out += hdr + pad(data)
+
+open(sys.argv[1], 'wb').write(out)
@@ -0,0 +1,10 @@
+struct otherstructname {
+	long othermembername;
+	struct otherstructname *othernext;
+};
+
+long
+otherfunctionname(struct otherstructname *o)
+{
+	return o->othermembername;
+}
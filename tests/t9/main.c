@@ -0,0 +1,7 @@
+#include "t.h"
+
+int
+main(void)
+{
+	return node_count(0) + node_insert(0, 0);
+}
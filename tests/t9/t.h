@@ -0,0 +1,19 @@
+typedef struct {
+	int		 x, y;
+} point;
+
+struct node;
+
+struct tree {
+	struct node	*root;
+	unsigned int	 count;
+};
+
+struct node {
+	struct node	*left, *right;
+	const point	*p;
+	struct tree	*tree;
+};
+
+int	node_count(struct tree *);
+int	node_insert(struct tree *, const point *);
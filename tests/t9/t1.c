@@ -0,0 +1,9 @@
+#include "t.h"
+
+struct tree	 t1_tree;
+
+int
+node_count(struct tree *t)
+{
+	return t->count;
+}
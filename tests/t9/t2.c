@@ -0,0 +1,10 @@
+#include "t.h"
+
+struct tree	 t2_tree;
+const point	 origin;
+
+int
+node_insert(struct tree *t, const point *p)
+{
+	return t->root->p == p;
+}